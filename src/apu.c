@@ -2,9 +2,21 @@
 
 #define APU_IMPLEMENTATION
 #include "apu.h"
+#include "scheduler.h"
+#include "timing.h"
 
 #include <tgmath.h>
 
+// The APU runs one step every 6 master clocks (every other CPU cycle)
+#define APU_STEP_CLOCKS 6
+#define APU_TIME_PER_CLOCK (0.3333333333 / 1789773)
+
+// Steps at which the frame counter clocks envelopes (every entry) and length counters/sweeps (odd entries)
+const uint32_t frame_counter_steps[4] = {3729, 7457, 11186, 14916};
+
+void frame_counter_event(uint64_t time);
+void schedule_frame_counter(uint64_t next_step);
+
 uint8_t length_table[32] = {10, 254, 20, 2,  40, 4,  80, 6,  160, 8,  60, 10, 14, 12, 26, 14,
                             12, 16,  24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30};
 
@@ -19,10 +31,15 @@ APU *apu_new() {
     apu->pulse1_osc.harmonics = 8; // 20 but too slow
     apu->pulse2_osc.amplitude = 1;
     apu->pulse2_osc.harmonics = 8;
+    apu->clock = scheduler_now();
+    scheduler_set_handler(EVENT_FRAME_COUNTER, &frame_counter_event);
+    schedule_frame_counter((apu->clock + APU_STEP_CLOCKS - 1) / APU_STEP_CLOCKS * APU_STEP_CLOCKS);
     return apu;
 }
 
 void apu_cpu_write(const uint16_t addr, const uint8_t data) {
+    // The write lands after the APU part of the current clock
+    apu_run_until(scheduler_now() + 1);
     switch (addr) {
         case 0x4000:
             switch ((data & 0xC0) >> 6) {
@@ -202,6 +219,7 @@ void apu_cpu_write(const uint16_t addr, const uint8_t data) {
 
 uint8_t apu_cpu_read(const uint16_t addr) {
     uint8_t data = 0x00;
+    apu_run_until(scheduler_now() + 1);
 
     if (addr == 0x4015) {
         data |= (apu->pulse1_lc.counter > 0) ? 0x01 : 0x00;
@@ -215,97 +233,114 @@ void right_shift(uint32_t *s) { *s = ((*s & 0x0001) << 7) | ((*s & 0x00FE) >> 1)
 
 void noise_func(uint32_t *s) { *s = (((*s & 0x0001) ^ ((*s & 0x0002) >> 1)) << 14) | ((*s & 0x7FFF) >> 1); }
 
-void apu_clock() {
-    apu->dGlobalTime += (0.3333333333 / 1789773);
+// Clock at which the frame counter reaches its next quarter frame, given the clock of the next APU step
+uint64_t frame_counter_time(const uint64_t next_step) {
+    return next_step + (uint64_t)(frame_counter_steps[apu->frame_step] - apu->frame_clock_counter - 1) * APU_STEP_CLOCKS;
+}
 
-    if (apu->clock_counter % 6 == 0) {
-        bool bHalfFrameClock = false;
-        bool bQuarterFrameClock = false;
-        apu->frame_clock_counter++;
+// The event only makes sure the APU is brought up to date at every quarter frame, the quarter frame itself is
+// clocked by apu_run_until() so it stays ordered with register writes landing on the same clock
+void schedule_frame_counter(const uint64_t next_step) {
+    scheduler_schedule(EVENT_FRAME_COUNTER, frame_counter_time(next_step) + 1);
+}
 
-        if (apu->frame_clock_counter == 3729) {
-            bQuarterFrameClock = true;
-        }
+void frame_counter_event(const uint64_t time) { apu_run_until(time); }
 
-        if (apu->frame_clock_counter == 7457) {
-            bQuarterFrameClock = true;
-            bHalfFrameClock = true;
-        }
+// One APU step, run on master clock `clock`
+void apu_step(const uint64_t clock) {
+    apu->dGlobalTime = (double)(clock + 1) * APU_TIME_PER_CLOCK;
 
-        if (apu->frame_clock_counter == 11186) {
-            bQuarterFrameClock = true;
-        }
+    sweep_track(&apu->pulse1_sweep, &apu->pulse1_seq.reload);
+    sweep_track(&apu->pulse2_sweep, &apu->pulse2_seq.reload);
 
-        if (apu->frame_clock_counter == 14916) {
-            bQuarterFrameClock = true;
-            bHalfFrameClock = true;
-            apu->frame_clock_counter = 0;
-        }
+    bool bHalfFrameClock = false;
+    bool bQuarterFrameClock = false;
+    apu->frame_clock_counter++;
 
-        if (bQuarterFrameClock) {
-            env_clock(&apu->pulse1_env, apu->pulse1_halt);
-            env_clock(&apu->pulse2_env, apu->pulse2_halt);
-            env_clock(&apu->noise_env, apu->noise_halt);
-        }
+    if (apu->frame_clock_counter == frame_counter_steps[apu->frame_step]) {
+        bQuarterFrameClock = true;
+        bHalfFrameClock = apu->frame_step % 2 == 1;
+        if (apu->frame_step == 3)
+            apu->frame_clock_counter = 0;
+        apu->frame_step = (apu->frame_step + 1) % 4;
+        schedule_frame_counter(clock + APU_STEP_CLOCKS);
+    }
 
-        if (bHalfFrameClock) {
-            len_clock(&apu->pulse1_lc, apu->pulse1_enable, apu->pulse1_halt);
-            len_clock(&apu->pulse2_lc, apu->pulse2_enable, apu->pulse2_halt);
-            len_clock(&apu->noise_lc, apu->noise_enable, apu->noise_halt);
-            sweep_clock(&apu->pulse1_sweep, &apu->pulse1_seq.reload, 0);
-            sweep_clock(&apu->pulse2_sweep, &apu->pulse2_seq.reload, 1);
-        }
+    if (bQuarterFrameClock) {
+        env_clock(&apu->pulse1_env, apu->pulse1_halt);
+        env_clock(&apu->pulse2_env, apu->pulse2_halt);
+        env_clock(&apu->noise_env, apu->noise_halt);
+    }
 
-        if (apu->bUseRawMode) {
-            seq_clock(&apu->pulse1_seq, apu->pulse1_enable, &right_shift);
-            apu->pulse1_sample = (double)apu->pulse1_seq.output;
-        } else {
-            apu->pulse1_osc.frequency = 1789773.0 / (16.0 * (double)(apu->pulse1_seq.reload + 1));
-            apu->pulse1_osc.amplitude = (double)(apu->pulse1_env.output - 1) / 16.0;
-            apu->pulse1_sample = osc_clock(&apu->pulse1_osc, apu->dGlobalTime);
-
-            if (apu->pulse1_lc.counter > 0 && apu->pulse1_seq.timer >= 8 && !apu->pulse1_sweep.mute && apu->pulse1_env.output > 2)
-                apu->pulse1_output += (apu->pulse1_sample - apu->pulse1_output) * 0.5;
-            else
-                apu->pulse1_output = 0;
-        }
+    if (bHalfFrameClock) {
+        len_clock(&apu->pulse1_lc, apu->pulse1_enable, apu->pulse1_halt);
+        len_clock(&apu->pulse2_lc, apu->pulse2_enable, apu->pulse2_halt);
+        len_clock(&apu->noise_lc, apu->noise_enable, apu->noise_halt);
+        sweep_clock(&apu->pulse1_sweep, &apu->pulse1_seq.reload, 0);
+        sweep_clock(&apu->pulse2_sweep, &apu->pulse2_seq.reload, 1);
+    }
 
-        if (apu->bUseRawMode) {
-            seq_clock(&apu->pulse2_seq, apu->pulse2_enable, &right_shift);
-            apu->pulse2_sample = (double)apu->pulse2_seq.output;
-        } else {
-            apu->pulse2_osc.frequency = 1789773.0 / (16.0 * (double)(apu->pulse2_seq.reload + 1));
-            apu->pulse2_osc.amplitude = (double)(apu->pulse2_env.output - 1) / 16.0;
-            apu->pulse2_sample = osc_clock(&apu->pulse2_osc, apu->dGlobalTime);
-
-            if (apu->pulse2_lc.counter > 0 && apu->pulse2_seq.timer >= 8 && !apu->pulse2_sweep.mute && apu->pulse2_env.output > 2)
-                apu->pulse2_output += (apu->pulse2_sample - apu->pulse2_output) * 0.5;
-            else
-                apu->pulse2_output = 0;
-        }
+    if (apu->bUseRawMode) {
+        seq_clock(&apu->pulse1_seq, apu->pulse1_enable, &right_shift);
+        apu->pulse1_sample = (double)apu->pulse1_seq.output;
+    } else {
+        apu->pulse1_osc.frequency = 1789773.0 / (16.0 * (double)(apu->pulse1_seq.reload + 1));
+        apu->pulse1_osc.amplitude = (double)(apu->pulse1_env.output - 1) / 16.0;
+        apu->pulse1_sample = osc_clock(&apu->pulse1_osc, apu->dGlobalTime);
 
-        seq_clock(&apu->noise_seq, apu->noise_enable, &noise_func);
+        if (apu->pulse1_lc.counter > 0 && apu->pulse1_seq.timer >= 8 && !apu->pulse1_sweep.mute && apu->pulse1_env.output > 2)
+            apu->pulse1_output += (apu->pulse1_sample - apu->pulse1_output) * 0.5;
+        else
+            apu->pulse1_output = 0;
+    }
 
-        if (apu->noise_lc.counter > 0 && apu->noise_seq.timer >= 8) {
-            apu->noise_output = (double)apu->noise_seq.output * ((double)(apu->noise_env.output - 1) / 16.0);
-        }
+    if (apu->bUseRawMode) {
+        seq_clock(&apu->pulse2_seq, apu->pulse2_enable, &right_shift);
+        apu->pulse2_sample = (double)apu->pulse2_seq.output;
+    } else {
+        apu->pulse2_osc.frequency = 1789773.0 / (16.0 * (double)(apu->pulse2_seq.reload + 1));
+        apu->pulse2_osc.amplitude = (double)(apu->pulse2_env.output - 1) / 16.0;
+        apu->pulse2_sample = osc_clock(&apu->pulse2_osc, apu->dGlobalTime);
 
-        if (!apu->pulse1_enable)
-            apu->pulse1_output = 0;
-        if (!apu->pulse2_enable)
+        if (apu->pulse2_lc.counter > 0 && apu->pulse2_seq.timer >= 8 && !apu->pulse2_sweep.mute && apu->pulse2_env.output > 2)
+            apu->pulse2_output += (apu->pulse2_sample - apu->pulse2_output) * 0.5;
+        else
             apu->pulse2_output = 0;
-        if (!apu->noise_enable)
-            apu->noise_output = 0;
     }
 
+    seq_clock(&apu->noise_seq, apu->noise_enable, &noise_func);
+
+    if (apu->noise_lc.counter > 0 && apu->noise_seq.timer >= 8) {
+        apu->noise_output = (double)apu->noise_seq.output * ((double)(apu->noise_env.output - 1) / 16.0);
+    }
+
+    if (!apu->pulse1_enable)
+        apu->pulse1_output = 0;
+    if (!apu->pulse2_enable)
+        apu->pulse2_output = 0;
+    if (!apu->noise_enable)
+        apu->noise_output = 0;
+}
+
+// Brings the APU up to master clock `end` (exclusive). Channels only change on every 6th clock, so this jumps from
+// step to step; sweep tracking and the visuals reflect the state after the last clock like the per-clock version did.
+void apu_run_until(const uint64_t end) {
+    if (apu->clock >= end)
+        return;
+    TIMING_START(start);
+
+    uint64_t step = (apu->clock + APU_STEP_CLOCKS - 1) / APU_STEP_CLOCKS * APU_STEP_CLOCKS;
+    for (; step < end; step += APU_STEP_CLOCKS)
+        apu_step(step);
+    apu->clock = end;
+
     sweep_track(&apu->pulse1_sweep, &apu->pulse1_seq.reload);
     sweep_track(&apu->pulse2_sweep, &apu->pulse2_seq.reload);
 
     apu->pulse1_visual = (apu->pulse1_enable && apu->pulse1_env.output > 1 && !apu->pulse1_sweep.mute) ? apu->pulse1_seq.reload : 2047;
     apu->pulse2_visual = (apu->pulse2_enable && apu->pulse2_env.output > 1 && !apu->pulse2_sweep.mute) ? apu->pulse2_seq.reload : 2047;
     apu->noise_visual = (apu->noise_enable && apu->noise_env.output > 1) ? apu->noise_seq.reload : 2047;
-
-    apu->clock_counter++;
+    TIMING_ADD(PHASE_APU, start);
 }
 
 double get_sample() {
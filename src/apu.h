@@ -46,7 +46,8 @@ typedef struct Sweeper {
 
 typedef struct APU {
     uint32_t frame_clock_counter;
-    uint32_t clock_counter;
+    uint8_t frame_step;    // Index of the next quarter frame in the frame counter sequence
+    uint64_t clock;        // Master clocks the APU has been run through
     bool bUseRawMode;
     double dGlobalTime;
 
@@ -92,7 +93,7 @@ typedef struct APU {
 
 void apu_cpu_write(uint16_t addr, uint8_t data);
 uint8_t apu_cpu_read(uint16_t addr);
-void apu_clock();
+void apu_run_until(uint64_t end);
 void apu_reset();
 
 double get_sample();
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "archive.h"
+
+#include "crc32.h"
+#include "inflate.h"
+
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+#define ZIP_LOCAL_SIGNATURE 0x04034B50
+#define ZIP_CENTRAL_SIGNATURE 0x02014B50
+#define ZIP_END_SIGNATURE 0x06054B50
+#define ZIP_END_SIZE 22
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+
+uint16_t read_le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+uint32_t read_le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+ArchiveType archive_type(const uint8_t *data, const size_t size) {
+    if (size >= 18 && data[0] == 0x1F && data[1] == 0x8B)
+        return ARCHIVE_GZIP;
+    if (size >= 30 && read_le32(data) == ZIP_LOCAL_SIGNATURE)
+        return ARCHIVE_ZIP;
+    return ARCHIVE_NONE;
+}
+
+// A compressed entry found in an archive
+typedef struct ArchiveEntry {
+    const uint8_t *data;
+    size_t size;
+    size_t unpacked_size;
+    uint32_t crc;
+    bool deflated;
+} ArchiveEntry;
+
+bool gzip_entry(const uint8_t *data, const size_t size, ArchiveEntry *entry) {
+    if (data[2] != 8) {
+        fprintf(stderr, "Unsupported gzip compression method %d.\n", data[2]);
+        return false;
+    }
+
+    const uint8_t flags = data[3];
+    const size_t end = size - 8;
+    size_t pos = 10;
+    if (flags & GZIP_FEXTRA)
+        pos = pos + 2 <= end ? pos + 2 + read_le16(data + pos) : end + 1;
+    if (flags & GZIP_FNAME)
+        while (pos < end && data[pos++] != 0) {}
+    if (flags & GZIP_FCOMMENT)
+        while (pos < end && data[pos++] != 0) {}
+    if (flags & GZIP_FHCRC)
+        pos += 2;
+    if (pos > end) {
+        fprintf(stderr, "Truncated gzip header.\n");
+        return false;
+    }
+
+    // The trailer has the CRC and the size modulo 4GB, plenty for a rom
+    entry->data = data + pos;
+    entry->size = end - pos;
+    entry->crc = read_le32(data + end);
+    entry->unpacked_size = read_le32(data + end + 4);
+    entry->deflated = true;
+    return true;
+}
+
+// Takes the entry from the central directory, local headers may leave the sizes to a data descriptor
+bool zip_entry(const uint8_t *data, const size_t size, ArchiveEntry *entry) {
+    const uint8_t *end = nullptr;
+    for (size_t pos = size - ZIP_END_SIZE + 1; pos-- > 0 && size - pos <= ZIP_END_SIZE + 0xFFFF;) {
+        if (read_le32(data + pos) == ZIP_END_SIGNATURE) {
+            end = data + pos;
+            break;
+        }
+    }
+    if (end == nullptr) {
+        fprintf(stderr, "Zip central directory not found.\n");
+        return false;
+    }
+    if (read_le16(end + 10) != 1) {
+        fprintf(stderr, "Zip archive has %d entries, expected a single rom.\n", read_le16(end + 10));
+        return false;
+    }
+
+    const size_t central = read_le32(end + 16);
+    if (central + 46 > size || read_le32(data + central) != ZIP_CENTRAL_SIGNATURE) {
+        fprintf(stderr, "Corrupt zip central directory.\n");
+        return false;
+    }
+    const uint8_t *header = data + central;
+    const uint16_t method = read_le16(header + 10);
+    const size_t local = read_le32(header + 42);
+    if (method != ZIP_STORED && method != ZIP_DEFLATED) {
+        fprintf(stderr, "Unsupported zip compression method %d.\n", method);
+        return false;
+    }
+    if (local + 30 > size || read_le32(data + local) != ZIP_LOCAL_SIGNATURE) {
+        fprintf(stderr, "Corrupt zip local header.\n");
+        return false;
+    }
+
+    const size_t start = local + 30 + read_le16(data + local + 26) + read_le16(data + local + 28);
+    entry->size = read_le32(header + 20);
+    if (start > size || size - start < entry->size) {
+        fprintf(stderr, "Truncated zip entry.\n");
+        return false;
+    }
+    entry->data = data + start;
+    entry->crc = read_le32(header + 16);
+    entry->unpacked_size = read_le32(header + 24);
+    entry->deflated = method == ZIP_DEFLATED;
+    return true;
+}
+
+// Unpacks a .gz or single entry .zip into an anonymous mapping sized from the archive's own record of the unpacked
+// size, so the rom is inflated in a single pass with no reallocation. The result is read-only and released with
+// munmap, the same as a mapped rom file.
+uint8_t *archive_unpack(const uint8_t *data, const size_t size, size_t *out_size) {
+    ArchiveEntry entry;
+    const ArchiveType type = archive_type(data, size);
+    if (type == ARCHIVE_NONE || !(type == ARCHIVE_GZIP ? gzip_entry(data, size, &entry) : zip_entry(data, size, &entry)))
+        return nullptr;
+    if (entry.unpacked_size == 0) {
+        fprintf(stderr, "Archive entry is empty.\n");
+        return nullptr;
+    }
+
+    uint8_t *out = mmap(nullptr, entry.unpacked_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (out == MAP_FAILED) {
+        fprintf(stderr, "Failed to allocate %zu bytes for the unpacked rom.\n", entry.unpacked_size);
+        return nullptr;
+    }
+
+    size_t written = entry.size;
+    if (entry.deflated) {
+        if (!inflate_raw(entry.data, entry.size, out, entry.unpacked_size, &written)) {
+            fprintf(stderr, "Corrupt compressed rom data.\n");
+            munmap(out, entry.unpacked_size);
+            return nullptr;
+        }
+    } else if (entry.size == entry.unpacked_size) {
+        memcpy(out, entry.data, entry.size);
+    }
+    if (written != entry.unpacked_size || crc32(0, out, written) != entry.crc) {
+        fprintf(stderr, "Compressed rom failed its CRC check.\n");
+        munmap(out, entry.unpacked_size);
+        return nullptr;
+    }
+
+    mprotect(out, entry.unpacked_size, PROT_READ);
+    *out_size = entry.unpacked_size;
+    return out;
+}
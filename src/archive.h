@@ -0,0 +1,16 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum ArchiveType {
+    ARCHIVE_NONE,
+    ARCHIVE_GZIP,
+    ARCHIVE_ZIP,
+} ArchiveType;
+
+ArchiveType archive_type(const uint8_t *data, size_t size);
+uint8_t *archive_unpack(const uint8_t *data, size_t size, size_t *out_size);
+
+#endif // ARCHIVE_H
@@ -0,0 +1,141 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "battery.h"
+
+#define BATTERY_FLUSH_MS 1000
+#define BATTERY_DIRTY_BITS 32
+
+bool has_suffix(const char *s, const size_t len, const char *suffix) {
+    const size_t n = strlen(suffix);
+    return len >= n && strncasecmp(s + len - n, suffix, n) == 0;
+}
+
+// "game.nes" or "game.nes.gz" -> "game.sav", next to the rom
+char *save_path_for(const char *rom_path) {
+    const char *dot = strrchr(rom_path, '.');
+    const char *slash = strrchr(rom_path, '/');
+    size_t len = dot != nullptr && (slash == nullptr || dot > slash) ? (size_t)(dot - rom_path) : strlen(rom_path);
+    if ((has_suffix(rom_path, strlen(rom_path), ".gz") || has_suffix(rom_path, strlen(rom_path), ".zip")) &&
+        has_suffix(rom_path, len, ".nes"))
+        len -= 4;
+    char *path = malloc(len + 5);
+    memcpy(path, rom_path, len);
+    strcpy(path + len, ".sav");
+    return path;
+}
+
+// Writes back the pages dirtied since the last call. Only the flush thread and battery_close() call it.
+void battery_flush(BatterySave *save) {
+    const uint32_t pages = atomic_exchange(&save->dirty, 0);
+    const size_t page_size = (size_t)1 << save->page_shift;
+    for (uint32_t i = 0; i < BATTERY_DIRTY_BITS; i++) {
+        if (!(pages & (1u << i)))
+            continue;
+        const size_t offset = (size_t)i << save->page_shift;
+        const size_t length = save->size - offset < page_size ? save->size - offset : page_size;
+        if (msync(save->data + offset, length, MS_SYNC) != 0)
+            fprintf(stderr, "Failed to write save file %s: %s\n", save->path, strerror(errno));
+    }
+}
+
+void *flush_thread(void *arg) {
+    BatterySave *save = arg;
+    pthread_mutex_lock(&save->lock);
+    while (save->running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += BATTERY_FLUSH_MS / 1000;
+        deadline.tv_nsec += (BATTERY_FLUSH_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&save->cond, &save->lock, &deadline);
+
+        pthread_mutex_unlock(&save->lock);
+        battery_flush(save);
+        pthread_mutex_lock(&save->lock);
+    }
+    pthread_mutex_unlock(&save->lock);
+    return nullptr;
+}
+
+// Maps `size` bytes of the rom's .sav file, creating or growing it as needed. Returns nullptr if the file can't be
+// used, the caller then falls back to RAM that isn't saved.
+BatterySave *battery_open(const char *rom_path, const size_t size) {
+    char *path = save_path_for(rom_path);
+    const int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open save file %s.\n", path);
+        free(path);
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)size && ftruncate(fd, (off_t)size) != 0)) {
+        fprintf(stderr, "Failed to resize save file %s.\n", path);
+        close(fd);
+        free(path);
+        return nullptr;
+    }
+
+    uint8_t *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Failed to map save file %s.\n", path);
+        close(fd);
+        free(path);
+        return nullptr;
+    }
+
+    BatterySave *save = calloc(1, sizeof(BatterySave));
+    save->path = path;
+    save->fd = fd;
+    save->data = data;
+    save->size = size;
+
+    // msync works on whole system pages; with more pages than dirty bits each bit covers several
+    save->page_shift = 0;
+    const size_t system_page = (size_t)sysconf(_SC_PAGESIZE);
+    while (((size_t)1 << save->page_shift) < system_page ||
+           (size >> save->page_shift) > BATTERY_DIRTY_BITS)
+        save->page_shift++;
+    atomic_init(&save->dirty, 0);
+
+    pthread_mutex_init(&save->lock, nullptr);
+    pthread_cond_init(&save->cond, nullptr);
+    save->running = true;
+    pthread_create(&save->thread, nullptr, &flush_thread, save);
+    return save;
+}
+
+void battery_close(BatterySave *save) {
+    pthread_mutex_lock(&save->lock);
+    save->running = false;
+    pthread_cond_broadcast(&save->cond);
+    pthread_mutex_unlock(&save->lock);
+    pthread_join(save->thread, nullptr);
+
+    battery_flush(save);
+    munmap(save->data, save->size);
+    close(save->fd);
+    pthread_mutex_destroy(&save->lock);
+    pthread_cond_destroy(&save->cond);
+    free(save->path);
+    free(save);
+}
+
+// Called by the emulation thread on every PRG-RAM write, never blocks
+void battery_mark_dirty(BatterySave *save, const uint32_t offset) {
+    const uint32_t bit = 1u << (offset >> save->page_shift);
+    if (!(atomic_load_explicit(&save->dirty, memory_order_relaxed) & bit))
+        atomic_fetch_or_explicit(&save->dirty, bit, memory_order_relaxed);
+}
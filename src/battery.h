@@ -0,0 +1,34 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "forward.h"
+
+// Battery-backed PRG-RAM. The RAM is a shared mapping of the .sav file next to the rom, so a write is just a store
+// into the page cache: the emulation thread only marks the page dirty and a background thread msyncs dirty pages
+// every BATTERY_FLUSH_MS.
+
+struct BatterySave {
+    char *path;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    uint8_t page_shift;   // Each dirty bit covers 1 << page_shift bytes, at least a system page
+    atomic_uint dirty;    // One bit per page written since the last flush
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+};
+
+BatterySave *battery_open(const char *rom_path, size_t size);
+void battery_close(BatterySave *save);
+
+void battery_mark_dirty(BatterySave *save, uint32_t offset);
+void battery_flush(BatterySave *save);
+
+#endif // BATTERY_H
@@ -1,19 +1,37 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "bus.h"
 
 #include "apu.h"
 #include "cartridge.h"
 #include "cpu.h"
+#include "mappers/mapper.h"
 #include "ppu.h"
+#include "ppu_deferred.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "timing.h"
+
+// NTSC master clock (PPU dots) per second
+#define MASTER_CLOCK_RATE 5369318
+// PCs listed in the profile report printed when the bus goes away
+#define PROFILE_TOP 40
 
 uint8_t bus_read(uint16_t addr);
 void bus_write(uint16_t addr, uint8_t data);
+void bus_nmi(void);
+void bus_ppu_status(void);
+void nmi_event(uint64_t time);
+void dma_event(uint64_t time);
+void sample_event(uint64_t time);
+void frame_end_event(uint64_t time);
 
 Bus *bus;
 
 Bus *bus_new() {
     bus = calloc(1, sizeof(Bus));
+    bus->scheduler = scheduler_new();
     bus->cpu = cpu_new(bus);
     bus->ppu = ppu_new();
     bus->apu = apu_new();
@@ -23,18 +41,105 @@ Bus *bus_new() {
     bus->dma_page = 0x00;
     bus->dma_addr = 0x00;
     bus->dma_data = 0x00;
-    bus->dma_odd_cycle = true;
     bus->dma_transfer_active = false;
+    bus->ppu->nmi = &bus_nmi;
+    bus->ppu->status_changed = &bus_ppu_status;
+
+    scheduler_set_handler(EVENT_NMI, &nmi_event);
+    scheduler_set_handler(EVENT_DMA, &dma_event);
+    scheduler_set_handler(EVENT_SAMPLE, &sample_event);
+    scheduler_set_handler(EVENT_FRAME_END, &frame_end_event);
     return bus;
 }
 
 void bus_free() {
+#ifdef ZNES_PROFILE
+    profiler_report(stderr, bus, PROFILE_TOP);
+    profiler_stop();
+#endif
     cpu_free(bus->cpu);
     if (bus->ppu != nullptr)
         ppu_free();
+    scheduler_free();
     free(bus);
 }
 
+// Called by the PPU while it is being clocked, the CPU takes the NMI once the current clock is over
+void bus_nmi(void) { scheduler_schedule(EVENT_NMI, bus->scheduler->now + 1); }
+
+// A loop polling $2002 only idles while the value it reads stays the same
+void bus_ppu_status(void) {
+    if (bus->cpu->idle && bus->cpu->idle_loop.polls_ppu)
+        cpu_wake();
+}
+
+void nmi_event(const uint64_t time) {
+    (void)time;
+    cpu_nmi();
+}
+
+// OAM DMA from a page whose reads have no side effects: copy the 256 bytes at once and only stall the CPU. The byte
+// by byte transfer waits for an odd CPU cycle before its 512 read/write cycles; the first DMA cycle is 3 clocks after
+// the $4014 write, so that's 513 cycles when the write happened on an even clock and 514 otherwise.
+void dma_bulk(const uint8_t page) {
+    TIMING_START(start);
+    const uint16_t addr = page << 8;
+    uint8_t *oam = bus->ppu->OAM_pointer;
+    const uint8_t *src = nullptr;
+    if (addr <= 0x1FFF)
+        src = &bus->ram[addr & 0x0700];
+    else if (addr >= 0x8000)
+        src = cart_prg_page(addr);
+
+    if (src != nullptr) {
+        memcpy(oam, src, 256);
+    } else {
+        for (int i = 0; i < 256; i++)
+            oam[i] = bus->read(addr | i);
+    }
+
+    if (bus->ppu->deferred) {
+        for (int i = 0; i < 256; i++)
+            ppu_deferred_log(PPU_LOG_OAM, i, oam[i]);
+    }
+    bus->dma_stall = bus->clock_count % 2 == 0 ? 513 : 514;
+    TIMING_ADD(PHASE_DMA, start);
+}
+
+// OAM DMA from an I/O page, one read or write per CPU cycle like the hardware. The first read comes right after the
+// alignment cycle; the CPU is stalled by dma_stall for the whole transfer. Reads from bus->dma_page, set by the
+// $4014 write.
+void dma_start(void) {
+    bus->dma_transfer_active = true;
+    bus->dma_write = false;
+    bus->dma_stall = bus->clock_count % 2 == 0 ? 513 : 514;
+    const uint64_t first_read = bus->clock_count % 2 == 0 ? 6 : 9;
+    scheduler_schedule(EVENT_DMA, bus->scheduler->now + first_read + 1);
+}
+
+// Fires one clock after the DMA cycle it stands for, the same point the per-clock loop used to run it at
+void dma_event(const uint64_t time) {
+    TIMING_START(start);
+    if (!bus->dma_write) {
+        bus->dma_data = bus->read(bus->dma_page << 8 | bus->dma_addr);
+        bus->dma_write = true;
+        scheduler_schedule(EVENT_DMA, time + 3);
+        TIMING_ADD(PHASE_DMA, start);
+        return;
+    }
+
+    bus->ppu->OAM_pointer[bus->dma_addr] = bus->dma_data;
+    if (bus->ppu->deferred)
+        ppu_deferred_log(PPU_LOG_OAM, bus->dma_addr, bus->dma_data);
+    bus->dma_write = false;
+    bus->dma_addr++;
+    if (bus->dma_addr == 0x00)
+        bus->dma_transfer_active = false;
+    else
+        scheduler_schedule(EVENT_DMA, time + 3);
+    TIMING_ADD(PHASE_DMA, start);
+}
+
 uint8_t bus_read(const uint16_t addr) {
     uint8_t data = 0x00;
     if (addr <= 0x1FFF) {
@@ -46,8 +151,10 @@ uint8_t bus_read(const uint16_t addr) {
     } else if (addr >= 0x4016 && addr <= 0x4017) {
         data = (bus->controller_cache[addr & 0x0001] & 0x80) > 0;
         bus->controller_cache[addr & 0x0001] <<= 1;
-    } else if (addr >= 0x8000) {
+    } else if (addr >= 0x6000 && addr <= 0x7FFF) {
         data = bus->cart->cpu_read(addr);
+    } else if (addr >= 0x8000) {
+        data = bus->cart->prg_banks[(addr >> 13) & 0x03][addr & 0x1FFF];
     }
 
     return data;
@@ -56,18 +163,24 @@ uint8_t bus_read(const uint16_t addr) {
 void bus_write(const uint16_t addr, const uint8_t data) {
     if (addr <= 0x1FFF) {
         bus->ram[addr & 0x07FF] = data;
+        if (bus->cpu->code_pages & (1 << ((addr >> 8) & 0x07)))
+            cpu_invalidate_ram(addr);
     } else if (addr >= 0x2000 && addr <= 0x3FFF) {
         bus->ppu->write(addr & 0x0007, data);
     } else if (addr == 0x4014) {
         bus->dma_page = data;
         bus->dma_addr = 0x00;
-        bus->dma_transfer_active = true;
+        // Reading PPU or APU registers has side effects, those pages still go one byte per cycle
+        if (data >= 0x20 && data <= 0x40)
+            dma_start();
+        else
+            dma_bulk(data);
     } else if ((addr >= 0x4000 && addr <= 0x4013) || addr == 0x4015 || addr == 0x4017) //  NES APU
     {
         bus->apu->write(addr, data);
     } else if (addr >= 0x4016 && addr <= 0x4017) {
         bus->controller_cache[addr & 0x0001] = bus->controller[addr & 0x0001];
-    } else if (addr >= 0x8000) {
+    } else if (addr >= 0x6000) {
         bus->cart->cpu_write(addr, data);
     }
 }
@@ -75,6 +188,12 @@ void bus_write(const uint16_t addr, const uint8_t data) {
 void set_cart(Cartridge *cart) {
     bus->cart = cart;
     bus->ppu->cart = cart;
+    cpu_set_cart(cart);
+#ifdef ZNES_PROFILE
+    profiler_start(cart);
+#endif
+    if (cart->mapper->event != nullptr)
+        scheduler_set_handler(EVENT_MAPPER, cart->mapper->event);
 }
 
 void bus_reset() {
@@ -84,60 +203,97 @@ void bus_reset() {
     bus->dma_page = 0x00;
     bus->dma_addr = 0x00;
     bus->dma_data = 0x00;
-    bus->dma_odd_cycle = true;
     bus->dma_transfer_active = false;
+    bus->dma_write = false;
+    bus->dma_stall = 0;
+    scheduler_cancel(EVENT_DMA);
+    scheduler_cancel(EVENT_NMI);
+    scheduler_cancel(EVENT_MAPPER);
+    bus->cpu->irq_line = 0;
+    if (bus->cart != nullptr && bus->cart->mapper->reset != nullptr)
+        bus->cart->mapper->reset();
 }
 
-double dAudioTime = 0.0;
-// double dAudioGlobalTime = 0.0;
-double dAudioTimePerNESClock = 0.0;
-double dAudioTimePerSystemSample = 0.0f;
+// Clock at which sample number `index` is due, exact integer math so the sample rate never drifts
+uint64_t sample_time(const uint64_t index) { return (index * MASTER_CLOCK_RATE + bus->sample_rate - 1) / bus->sample_rate; }
 
-void SetSampleFrequency(uint32_t sample_rate) {
-    dAudioTimePerSystemSample = 1.0 / (double)sample_rate;
-    dAudioTimePerNESClock = 1.0 / 5369318.0; // PPU Clock Frequency
+void SetSampleFrequency(const uint32_t sample_rate) {
+    bus->sample_rate = sample_rate;
+    bus->sample_index = bus->scheduler->now * sample_rate / MASTER_CLOCK_RATE + 1;
+    scheduler_schedule(EVENT_SAMPLE, sample_time(bus->sample_index));
 }
 
-bool bus_clock() {
-    apu_clock();
+void sample_event(const uint64_t time) {
+    apu_run_until(time);
+    bus->dAudioSample = get_sample();
+    bus->sample_ready = true;
+    if (bus->audio_out != nullptr)
+        bus->audio_out(bus->dAudioSample);
+    bus->sample_index++;
+    scheduler_schedule(EVENT_SAMPLE, sample_time(bus->sample_index));
+}
+
+// Nothing to do: the event only exists so that bus_run_frame()'s inner loop, which runs until the next event, stops
+// at the end of the frame
+void frame_end_event(const uint64_t time) { (void)time; }
+
+#ifdef ZNES_TIMING
+// bus_tick() with its PPU and CPU parts timed, see timing.h
+void bus_tick_sampled(void) {
+    timing.countdown = TIMING_SAMPLE_PERIOD;
+    const uint64_t start = timing_now();
     ppu_clock();
+    const uint64_t ppu_done = timing_now();
     if (bus->clock_count % 3 == 0) {
-        if (bus->dma_transfer_active) {
-            if (bus->dma_odd_cycle) {
-                if (bus->clock_count % 2 == 1) {
-                    bus->dma_odd_cycle = false;
-                }
-            } else {
-                if (bus->clock_count % 2 == 0) {
-                    bus->dma_data = bus->read(bus->dma_page << 8 | bus->dma_addr);
-                } else {
-                    bus->ppu->OAM_pointer[bus->dma_addr] = bus->dma_data;
-                    bus->dma_addr++;
-                    if (bus->dma_addr == 0x00) {
-                        bus->dma_transfer_active = false;
-                        bus->dma_odd_cycle = true;
-                    }
-                }
-            }
-        } else {
+        if (bus->dma_stall > 0)
+            bus->dma_stall--;
+        else
             cpu_clock();
-        }
     }
+    timing.sampled[PHASE_PPU] += ppu_done - start;
+    timing.sampled[PHASE_CPU] += timing_now() - ppu_done;
+    bus->clock_count++;
+    bus->scheduler->now++;
+}
+#endif
 
-    bool bAudioSampleReady = false;
-    dAudioTime += dAudioTimePerNESClock;
-    if (dAudioTime >= dAudioTimePerSystemSample) {
-        dAudioTime -= dAudioTimePerSystemSample;
-        bus->dAudioSample = get_sample();
-        bAudioSampleReady = true;
+// One master clock: a PPU dot and, every third clock, a CPU cycle unless DMA holds the CPU. The APU catches up on its
+// own when it is accessed or has an event due.
+void bus_tick(void) {
+#ifdef ZNES_TIMING
+    if (TIMING_SAMPLE_DUE()) {
+        bus_tick_sampled();
+        return;
     }
-
-    if (bus->ppu->nmi) {
-        bus->ppu->nmi = false;
-        cpu_nmi();
+#endif
+    ppu_clock();
+    if (bus->clock_count % 3 == 0) {
+        if (bus->dma_stall > 0)
+            bus->dma_stall--;
+        else
+            cpu_clock();
     }
-
     bus->clock_count++;
+    bus->scheduler->now++;
+}
 
-    return bAudioSampleReady;
+// Single steps one master clock, returns true if an audio sample was produced
+bool bus_clock() {
+    bus->sample_ready = false;
+    bus_tick();
+    if (bus->scheduler->now >= bus->scheduler->next)
+        scheduler_dispatch();
+    return bus->sample_ready;
+}
+
+// Runs until the PPU completes a frame, only stopping the straight-line clock loop when an event is due
+void bus_run_frame(void) {
+    Scheduler *s = bus->scheduler;
+    scheduler_schedule(EVENT_FRAME_END, s->now + ppu_clocks_to_frame_end());
+    while (!bus->ppu->frame_complete) {
+        while (s->now < s->next)
+            bus_tick();
+        scheduler_dispatch();
+    }
+    scheduler_cancel(EVENT_FRAME_END);
 }
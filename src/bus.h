@@ -6,6 +6,7 @@
 #include "forward.h"
 
 struct Bus {
+    Scheduler *scheduler;
     Cpu *cpu;
     PPU *ppu;
     APU *apu;
@@ -19,9 +20,15 @@ struct Bus {
     uint8_t dma_page;
     uint8_t dma_addr;
     uint8_t dma_data;
-    bool dma_odd_cycle;
+    bool dma_write; // Next DMA cycle stores dma_data to OAM
     bool dma_transfer_active;
+    uint16_t dma_stall; // CPU cycles left until the current OAM DMA releases the CPU
+
+    uint32_t sample_rate;
+    uint64_t sample_index;
+    bool sample_ready;
     double dAudioSample;
+    void (*audio_out)(double sample); // Called with every sample when set
 };
 
 Bus *bus_new();
@@ -32,5 +39,6 @@ void bus_reset();
 
 void SetSampleFrequency(uint32_t sample_rate);
 bool bus_clock();
+void bus_run_frame(void);
 
 #endif // BUS_H
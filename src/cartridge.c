@@ -1,112 +1,284 @@
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "archive.h"
+#include "battery.h"
 #include "cartridge.h"
+#include "ppu_deferred.h"
+#include "romdb.h"
 #include "mappers/mapper_000.h"
+#include "mappers/mapper_001.h"
 #include "mappers/mapper_002.h"
+#include "mappers/mapper_004.h"
 
 uint8_t cart_cpu_read(uint16_t addr);
 void cart_cpu_write(uint16_t addr, uint8_t data);
 uint8_t cart_ppu_read(uint16_t addr);
 void cart_ppu_write(uint16_t addr, uint8_t data);
 
-Cartridge *cart;
+thread_local Cartridge *cart;
+
+// PRG-RAM is seen through an 8KB window and CHR through 1KB slots: round the header's sizes up to what the banking
+// can address
+void normalize_ram_sizes(CartridgeInfo *info) {
+    info->prg_ram_size = (info->prg_ram_size + PRG_RAM_SIZE - 1) / PRG_RAM_SIZE * PRG_RAM_SIZE;
+    if (info->prg_ram_size == 0)
+        info->prg_ram_size = PRG_RAM_SIZE;
+    if (info->chr_rom_size == 0 && info->chr_ram_size < CHR_RAM_SIZE)
+        info->chr_ram_size = CHR_RAM_SIZE;
+}
+
+void parse_ines(const INesHeader *header, CartridgeInfo *info) {
+    const uint8_t *raw = (const uint8_t *)header;
+    info->version = 1;
+    info->prg_rom_size = header->prg_rom_pages * 16 * 1024;
+    info->chr_rom_size = header->chr_rom_pages * 8 * 1024;
+
+    // Bytes 12-15 are zero in a clean header. Old dumps have text there ("DiskDude!") starting in byte 7, so its mapper
+    // bits are garbage too.
+    const bool tagged = raw[12] != 0 || raw[13] != 0 || raw[14] != 0 || raw[15] != 0;
+    info->mapper = (tagged ? 0 : header->mapper2 & 0xF0) | header->mapper1 >> 4;
+
+    info->mirror = (header->mapper1 & 0x01) ? VERTICAL : HORIZONTAL;
+    info->battery = header->mapper1 & 0x02;
+    info->trainer = header->mapper1 & 0x04;
+    // A count of 0 means 8KB for compatibility with older dumps
+    info->prg_ram_size = (header->prg_ram_pages > 0 && !tagged ? header->prg_ram_pages : 1) * PRG_RAM_SIZE;
+    info->prg_nvram_size = info->battery ? info->prg_ram_size : 0;
+    info->chr_ram_size = info->chr_rom_size == 0 ? CHR_RAM_SIZE : 0;
+    info->timing = !tagged && (header->tv_system1 & 0x01) ? TIMING_PAL : TIMING_NTSC;
+    normalize_ram_sizes(info);
+}
+
+// NES 2.0 ROM size: a page count, or 2^E * (M * 2 + 1) bytes when the MSB nibble is $F. False when it doesn't fit in
+// 32 bits, E goes up to 63.
+bool nes2_rom_size(const uint8_t lsb, const uint8_t msb, const uint32_t page_size, uint32_t *size) {
+    uint64_t bytes;
+    if (msb == 0x0F) {
+        if ((lsb >> 2) >= 32)
+            return false;
+        bytes = ((uint64_t)1 << (lsb >> 2)) * ((lsb & 0x03) * 2 + 1);
+    } else {
+        bytes = (uint64_t)((uint32_t)msb << 8 | lsb) * page_size;
+    }
+    if (bytes > UINT32_MAX)
+        return false;
+    *size = (uint32_t)bytes;
+    return true;
+}
+
+// NES 2.0 RAM size: 64 << shift bytes, 0 for none
+uint32_t nes2_ram_size(const uint8_t shift) { return shift == 0 ? 0 : 64u << shift; }
+
+// Replaces what the header says about the board
+void apply_database_entry(const RomDbEntry *entry, CartridgeInfo *info) {
+    if (info->mapper != entry->mapper || info->prg_rom_size != entry->prg_rom_size ||
+        info->chr_rom_size != entry->chr_rom_size)
+        fprintf(stderr, "WARN: Bad header (mapper %d, %u/%u bytes PRG/CHR), using database entry (mapper %d, %u/%u).\n",
+                info->mapper, info->prg_rom_size, info->chr_rom_size, entry->mapper, entry->prg_rom_size,
+                entry->chr_rom_size);
+
+    info->mapper = entry->mapper;
+    info->submapper = entry->submapper;
+    info->prg_rom_size = entry->prg_rom_size;
+    info->chr_rom_size = entry->chr_rom_size;
+    info->mirror = entry->mirror;
+    info->timing = entry->timing;
+    info->prg_nvram_size = nes2_ram_size(entry->prg_nvram_shift);
+    info->prg_ram_size = nes2_ram_size(entry->prg_ram_shift) + info->prg_nvram_size;
+    info->battery = info->prg_nvram_size > 0;
+    info->chr_ram_size = nes2_ram_size(entry->chr_ram_shift);
+    info->from_database = true;
+    normalize_ram_sizes(info);
+}
+
+// False when the ROM sizes are too large to be real
+bool parse_nes2(const INesHeader *header, CartridgeInfo *info) {
+    info->version = 2;
+    info->mapper = (uint16_t)(header->prg_ram_pages & 0x0F) << 8 | (header->mapper2 & 0xF0) | header->mapper1 >> 4;
+    info->submapper = header->prg_ram_pages >> 4;
+    if (!nes2_rom_size(header->prg_rom_pages, header->tv_system1 & 0x0F, 16 * 1024, &info->prg_rom_size) ||
+        !nes2_rom_size(header->chr_rom_pages, header->tv_system1 >> 4, 8 * 1024, &info->chr_rom_size))
+        return false;
+
+    info->mirror = (header->mapper1 & 0x01) ? VERTICAL : HORIZONTAL;
+    info->trainer = header->mapper1 & 0x04;
+    info->prg_nvram_size = nes2_ram_size(header->tv_system2 >> 4);
+    info->prg_ram_size = nes2_ram_size(header->tv_system2 & 0x0F) + info->prg_nvram_size;
+    info->battery = (header->mapper1 & 0x02) || info->prg_nvram_size > 0;
+    info->chr_ram_size = nes2_ram_size(header->chr_ram & 0x0F) + nes2_ram_size(header->chr_ram >> 4);
+    info->timing = header->timing & 0x03;
+    normalize_ram_sizes(info);
+    return true;
+}
 
 Cartridge *cartridge_new(const char *path) {
-    FILE *rom_file = fopen(path, "r");
-    if (rom_file == NULL) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "Error opening the file.\n");
         return nullptr;
     }
 
-    INesHeader header;
-    if (fread((char *)&header, 1, 16, rom_file) != 16) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(INesHeader)) {
         fprintf(stderr, "Failed to read rom header.\n");
+        close(fd);
         return nullptr;
     }
 
+    // PRG and CHR-ROM are used straight from a read-only private mapping: nothing is copied at startup and every
+    // instance running the same rom shares the page cache
+    size_t rom_size = st.st_size;
+    uint8_t *rom = mmap(nullptr, rom_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (rom == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the rom file.\n");
+        return nullptr;
+    }
+
+    // A .nes.gz or .zip is inflated into an anonymous mapping that then stands in for the file
+    if (archive_type(rom, rom_size) != ARCHIVE_NONE) {
+        size_t unpacked_size;
+        uint8_t *unpacked = archive_unpack(rom, rom_size, &unpacked_size);
+        munmap(rom, rom_size);
+        if (unpacked == nullptr)
+            return nullptr;
+        rom = unpacked;
+        rom_size = unpacked_size;
+        if (rom_size < sizeof(INesHeader)) {
+            fprintf(stderr, "Failed to read rom header.\n");
+            munmap(rom, rom_size);
+            return nullptr;
+        }
+    }
+
+    INesHeader header;
+    memcpy(&header, rom, sizeof(INesHeader));
+
     const uint8_t NES_HEADER[4] = {0x4E, 0x45, 0x53, 0x1A};
     for (int i = 0; i < 4; i++) {
         if (header.magic[i] != NES_HEADER[i]) {
             fprintf(stderr, "Not a NES rom.\n");
+            munmap(rom, rom_size);
             return nullptr;
         }
     }
 
-    if (header.mapper1 & 0x04)
-        fseek(rom_file, 512, SEEK_CUR); // 512-byte trainer
-
     cart = calloc(1, sizeof(Cartridge));
     CartridgeInfo *info = calloc(1, sizeof(CartridgeInfo));
     cart->info = info;
-    cart->mirror = (header.mapper1 & 0x01) ? VERTICAL : HORIZONTAL;
-    info->mapper = ((header.mapper2 >> 4) << 4) | (header.mapper1 >> 4);
-
-    uint8_t ines_version = 1;
-    if ((header.mapper2 & 0x0C) == 0x08)
-        ines_version = 2;
-
-    if (ines_version == 0) {
-        /*
-        const uint32_t prg_rom_pages = (unsigned int) header[4];
-        const uint32_t chr_rom_pages = (unsigned int) header[5];
-        const MirroringType mirroring = is_bit_set(header[6], 0) ? VERTICAL : HORIZONTAL;
-        const bool has_prg_ram = is_bit_set(header[6], 1);
-        const bool has_trainer = is_bit_set(header[6], 2);
-        const bool ignore_mirroring = is_bit_set(header[6], 3);
-        const uint32_t mapper = (header[6] & 0xF0) >> 4 & (header[7] & 0xF0);
-
-        const bool vs_unisystem = (header[7] & 0x0F) > 0;
-        const bool playchoice = is_bit_set(header[7], 1);
-        const bool nes2_header = is_bit_set(header[7], 2);
-        */
-        fprintf(stderr, "Not implemented support for iNes Header v0.\n");
-        return nullptr;
-    }
+    cart->rom = rom;
+    cart->rom_size = rom_size;
 
-    if (ines_version == 1) {
-        info->prg_rom_pages = header.prg_rom_pages;
-        info->prg_rom_size = header.prg_rom_pages * 16 * 1024;
-        cart->pgr = calloc(1, info->prg_rom_size);
-        uint32_t read = fread(cart->pgr, 1, info->prg_rom_size, rom_file);
-        if (read != info->prg_rom_size) {
-            fprintf(stderr, "Failed to read rom PGR data.\n Expected %d bytes but only got %d bytes.\n", info->prg_rom_size, read);
+    if ((header.mapper2 & 0x0C) == 0x08) {
+        if (!parse_nes2(&header, info)) {
+            fprintf(stderr, "Rom header gives a PRG or CHR-ROM size over 4GB.\n");
+            cartridge_free(cart);
             return nullptr;
         }
+    } else {
+        parse_ines(&header, info);
+    }
 
-        info->chr_rom_pages = header.chr_rom_pages;
-        info->chr_rom_size = header.chr_rom_pages * 8 * 1024;
-        cart->chr = calloc(1, info->chr_rom_size);
-        read = fread(cart->chr, 1, info->chr_rom_size, rom_file);
-        if (read != info->chr_rom_size) {
-            fprintf(stderr, "Failed to read rom CHR data.\n Expected %d bytes but only got %d bytes.\n", info->chr_rom_size, read);
-            return nullptr;
-        }
+    size_t offset = sizeof(INesHeader);
+    if (info->trainer)
+        offset += 512; // 512-byte trainer
+    if (rom_size < offset) {
+        fprintf(stderr, "Failed to read rom trainer.\n");
+        cartridge_free(cart);
+        return nullptr;
     }
 
-    if (ines_version == 2) {
-        fprintf(stderr, "Not implemented support for iNes Header v2.\n");
+    // Known dumps get their board from the database instead of trusting the header. The hash covers PRG and CHR as
+    // the header sizes them, or everything after the header when those sizes don't fit the file.
+    const size_t data_size = rom_size - offset;
+    const size_t hashed = info->prg_rom_size + (size_t)info->chr_rom_size;
+    const RomDbEntry *entry = romdb_lookup(rom + offset, hashed <= data_size ? hashed : data_size, &info->crc32);
+    if (entry == nullptr && hashed < data_size)
+        entry = romdb_lookup(rom + offset, data_size, nullptr);
+    if (entry != nullptr)
+        apply_database_entry(entry, info);
+
+    if (info->prg_rom_size == 0) {
+        fprintf(stderr, "Rom has no PGR data.\n");
+        cartridge_free(cart);
+        return nullptr;
+    }
+    // The banking, the decode cache and the code/data log all work in whole 8KB PRG and 1KB CHR banks
+    if (info->prg_rom_size % PRG_BANK_SIZE != 0 || info->chr_rom_size % CHR_BANK_SIZE != 0) {
+        fprintf(stderr, "Unsupported rom size, %u bytes PRG and %u CHR aren't whole 8KB and 1KB banks.\n",
+                info->prg_rom_size, info->chr_rom_size);
+        cartridge_free(cart);
+        return nullptr;
+    }
+    if (data_size < info->prg_rom_size) {
+        fprintf(stderr, "Failed to read rom PGR data.\n Expected %d bytes but only got %zu bytes.\n", info->prg_rom_size,
+                data_size);
+        cartridge_free(cart);
         return nullptr;
     }
+    cart->pgr = rom + offset;
+    offset += info->prg_rom_size;
 
-    fgetc(rom_file);
-    if (!feof(rom_file)) {
-        fprintf(stderr, "WARN: Read everything but file still has data...\n");
+    if (info->chr_rom_size == 0) {
+        // No CHR-ROM, the board has CHR-RAM instead
+        cart->chr_ram = true;
+        cart->chr = calloc(1, info->chr_ram_size);
+    } else {
+        if (rom_size < offset + info->chr_rom_size) {
+            fprintf(stderr, "Failed to read rom CHR data.\n Expected %d bytes but only got %zu bytes.\n", info->chr_rom_size,
+                    rom_size - offset);
+            cartridge_free(cart);
+            return nullptr;
+        }
+        // Never written: CHR-ROM writes are dropped by cart_ppu_write()
+        cart->chr = rom + offset;
+        offset += info->chr_rom_size;
     }
+    cart->pgr_size = info->prg_rom_size;
+    cart->chr_size = cart->chr_ram ? info->chr_ram_size : info->chr_rom_size;
+    cart->mirror = info->mirror;
 
-    fclose(rom_file);
+    if (offset < rom_size) {
+        fprintf(stderr, "WARN: Read everything but file still has data...\n");
+    }
+    if (info->timing == TIMING_PAL || info->timing == TIMING_DENDY)
+        fprintf(stderr, "WARN: %s rom, running it with NTSC timing.\n", info->timing == TIMING_PAL ? "PAL" : "Dendy");
 
     switch (info->mapper) {
         case 0:
             cart->mapper = new_mapper_000(info);
+            break;
+        case 1:
+            cart->mapper = new_mapper_001(info);
+            break;
         case 2:
             cart->mapper = new_mapper_002(info);
             break;
+        case 4:
+            cart->mapper = new_mapper_004(info);
+            break;
         default:
             fprintf(stderr, "Mapper %d not implemented yet.\n", info->mapper);
+            cartridge_free(cart);
             return nullptr;
     }
 
+    // Without a battery the RAM is still there, it just isn't saved
+    if (info->battery)
+        cart->save = battery_open(path, info->prg_ram_size);
+    cart->prg_ram = cart->save != nullptr ? cart->save->data : calloc(1, info->prg_ram_size);
+    cart->prg_ram_size = info->prg_ram_size;
+    cart->prg_ram_enabled = true;
+    cart_map_prg_ram(0);
+    if (info->trainer)
+        memcpy(&cart->prg_ram[0x1000], rom + sizeof(INesHeader), 512); // Loaded at $7000
+
     cart->cpu_read = &cart_cpu_read;
     cart->cpu_write = &cart_cpu_write;
     cart->ppu_read = &cart_ppu_read;
@@ -115,42 +287,151 @@ Cartridge *cartridge_new(const char *path) {
 }
 
 void cartridge_free(Cartridge *cart) {
+    if (cart->save != nullptr)
+        battery_close(cart->save); // Flushes and unmaps the RAM
+    else
+        free(cart->prg_ram);
+    if (cart->mapper != nullptr)
+        mapper_free(cart->mapper);
     free(cart->info);
-    free(cart->pgr);
-    free(cart->chr);
+    if (cart->chr_ram)
+        free(cart->chr);
+    munmap(cart->rom, cart->rom_size);
     free(cart);
 }
 
-uint8_t cart_cpu_read(const uint16_t addr) {
-    uint32_t mapped_addr;
-    uint8_t value;
-    if (cart->mapper->cpu_read(addr, &mapped_addr, &value)) {
-        return value;
-    }
-    return cart->pgr[mapped_addr];
+// Points a clone's CHR slots at its own copy of the CHR-RAM
+void rebase_chr_banks(Cartridge *dst, const Cartridge *src) {
+    for (int i = 0; i < CHR_SLOTS; i++)
+        dst->chr_banks[i] = dst->chr + (src->chr_banks[i] - src->chr);
 }
 
-void cart_cpu_write(const uint16_t addr, const uint8_t data) {
-    uint32_t mapped_addr;
-    if (cart->mapper->cpu_write(addr, &mapped_addr, data)) {
-        return;
+// Copy of the cartridge for the PPU render thread. ROM is shared, CHR-RAM gets a private copy since the
+// emulation thread may already be writing the next frame's tiles.
+Cartridge *cartridge_clone(const Cartridge *src) {
+    Cartridge *clone = malloc(sizeof(Cartridge));
+    memcpy(clone, src, sizeof(Cartridge));
+    if (src->chr_ram) {
+        clone->chr = malloc(src->chr_size);
+        memcpy(clone->chr, src->chr, src->chr_size);
+        rebase_chr_banks(clone, src);
     }
-    cart->pgr[mapped_addr] = data;
+    return clone;
 }
 
-uint8_t cart_ppu_read(const uint16_t addr) {
-    uint32_t mapped_addr;
-    uint8_t value;
-    if (cart->mapper->ppu_read(addr, &mapped_addr, &value)) {
-        return value;
+void cartridge_free_clone(Cartridge *clone) {
+    if (clone->chr_ram)
+        free(clone->chr);
+    free(clone);
+}
+
+// Copies src into a clone made by cartridge_clone(), reusing the clone's CHR-RAM buffer
+void cartridge_copy_state(Cartridge *dst, const Cartridge *src) {
+    uint8_t *chr = dst->chr;
+    memcpy(dst, src, sizeof(Cartridge));
+    if (src->chr_ram) {
+        dst->chr = chr;
+        memcpy(dst->chr, src->chr, src->chr_size);
+        rebase_chr_banks(dst, src);
     }
-    return cart->chr[mapped_addr];
 }
 
-void cart_ppu_write(const uint16_t addr, const uint8_t data) {
-    uint32_t mapped_addr;
-    if (cart->mapper->ppu_write(addr, &mapped_addr, data)) {
+// Selects the cartridge used by the cart_* accessors on the calling thread
+void cartridge_bind(Cartridge *c) { cart = c; }
+
+void cart_set_mirror(const MirroringType mirror) {
+    if (cart->mirror == mirror)
+        return;
+    cart->mirror = mirror;
+    if (ppu_deferred_active())
+        ppu_deferred_log(PPU_LOG_MIRROR, 0x00, mirror);
+}
+
+void cart_set_prg_ram_enabled(const bool enabled) { cart->prg_ram_enabled = enabled; }
+
+// Direct pointer to the 256 byte PRG page at addr, pages never straddle an 8KB bank
+const uint8_t *cart_prg_page(const uint16_t addr) { return &cart->prg_banks[(addr >> 13) & 0x03][addr & 0x1F00]; }
+
+// Where $8000-$FFFF currently lands in PRG-ROM
+uint32_t cart_prg_offset(const uint16_t addr) {
+    return (uint32_t)(cart->prg_banks[(addr >> 13) & 0x03] - cart->pgr) + (addr & 0x1FFF);
+}
+
+// Wraps a bank number into [0, count). cartridge_new() only takes whole banks so count is at least 1, 0 is treated
+// as 1 only so that a bad count can't divide by zero.
+uint32_t wrap_bank(const int32_t bank, const uint32_t count) {
+    const int32_t n = count > 0 ? (int32_t)count : 1;
+    return (uint32_t)(((bank % n) + n) % n);
+}
+
+void cart_map_prg_8k(const uint8_t slot, const int32_t bank) {
+    cart->prg_banks[slot & 0x03] = &cart->pgr[wrap_bank(bank, cart->pgr_size / PRG_BANK_SIZE) * PRG_BANK_SIZE];
+}
+
+void cart_map_prg_16k(const uint8_t slot, const int32_t bank) {
+    const uint32_t b = wrap_bank(bank, cart->pgr_size / (2 * PRG_BANK_SIZE)) * 2;
+    cart_map_prg_8k(slot * 2, b);
+    cart_map_prg_8k(slot * 2 + 1, b + 1);
+}
+
+void cart_map_prg_32k(const int32_t bank) {
+    const uint32_t b = wrap_bank(bank, cart->pgr_size / (4 * PRG_BANK_SIZE)) * 4;
+    for (int i = 0; i < PRG_SLOTS; i++)
+        cart_map_prg_8k(i, b + i);
+}
+
+// Selects the 8KB of PRG-RAM seen at $6000-$7FFF
+void cart_map_prg_ram(const int32_t bank) {
+    cart->prg_ram_bank = &cart->prg_ram[wrap_bank(bank, cart->prg_ram_size / PRG_RAM_SIZE) * PRG_RAM_SIZE];
+}
+
+void cart_map_chr_1k(const uint8_t slot, const int32_t bank) {
+    const uint32_t b = wrap_bank(bank, cart->chr_size / CHR_BANK_SIZE);
+    uint8_t *ptr = &cart->chr[b * CHR_BANK_SIZE];
+    if (cart->chr_banks[slot & 0x07] == ptr)
+        return;
+    cart->chr_banks[slot & 0x07] = ptr;
+    // The render thread's copy of the cartridge has to switch at the same dot
+    if (ppu_deferred_active())
+        ppu_deferred_log(PPU_LOG_CHR_BANK, slot & 0x07, b);
+}
+
+void cart_map_chr_4k(const uint8_t slot, const int32_t bank) {
+    const uint32_t b = wrap_bank(bank, cart->chr_size / (4 * CHR_BANK_SIZE)) * 4;
+    for (int i = 0; i < 4; i++)
+        cart_map_chr_1k((slot & 0x01) * 4 + i, b + i);
+}
+
+void cart_map_chr_8k(const int32_t bank) {
+    const uint32_t b = wrap_bank(bank, cart->chr_size / (8 * CHR_BANK_SIZE)) * 8;
+    for (int i = 0; i < CHR_SLOTS; i++)
+        cart_map_chr_1k(i, b + i);
+}
+
+// $6000-$FFFF, disabled PRG-RAM reads as open bus
+uint8_t cart_cpu_read(const uint16_t addr) {
+    if (addr < 0x8000)
+        return cart->prg_ram_enabled ? cart->prg_ram_bank[addr & 0x1FFF] : 0x00;
+    return cart->prg_banks[(addr >> 13) & 0x03][addr & 0x1FFF];
+}
+
+// PRG-ROM is read-only, only the mapper gets to see writes
+void cart_cpu_write(const uint16_t addr, const uint8_t data) {
+    if (addr < 0x8000) {
+        if (!cart->prg_ram_enabled)
+            return;
+        cart->prg_ram_bank[addr & 0x1FFF] = data;
+        if (cart->save != nullptr)
+            battery_mark_dirty(cart->save, (uint32_t)(&cart->prg_ram_bank[addr & 0x1FFF] - cart->prg_ram));
         return;
     }
-    cart->chr[mapped_addr] = data;
+    if (cart->mapper->write != nullptr)
+        cart->mapper->write(addr, data);
+}
+
+uint8_t cart_ppu_read(const uint16_t addr) { return cart->chr_banks[(addr >> 10) & 0x07][addr & 0x03FF]; }
+
+void cart_ppu_write(const uint16_t addr, const uint8_t data) {
+    if (cart->chr_ram)
+        cart->chr_banks[(addr >> 10) & 0x07][addr & 0x03FF] = data;
 }
@@ -1,36 +1,64 @@
 #ifndef CARTRIDGE_H
 #define CARTRIDGE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "forward.h"
 
+typedef enum MirroringType {
+    HORIZONTAL,
+    VERTICAL,
+    ONESCREEN_LO,
+    ONESCREEN_HI,
+} MirroringType;
+
+typedef enum TimingType {
+    TIMING_NTSC,
+    TIMING_PAL,
+    TIMING_MULTI,
+    TIMING_DENDY,
+} TimingType;
+
 struct CartridgeInfo {
-    uint8_t prg_rom_pages;
-    uint8_t chr_rom_pages;
+    uint8_t version; // 1 for iNES, 2 for NES 2.0
     uint32_t prg_rom_size;
     uint32_t chr_rom_size;
-    uint8_t mapper;
+    uint32_t prg_ram_size;   // Everything at $6000-$7FFF, battery-backed or not
+    uint32_t prg_nvram_size; // Battery-backed part of it
+    uint32_t chr_ram_size;
+    uint16_t mapper;
+    uint8_t submapper;
+    MirroringType mirror;
+    TimingType timing;
+    bool battery;
+    bool trainer;
+    uint32_t crc32; // PRG + CHR-ROM
+    bool from_database;
 };
 
 struct INesHeader {
     char magic[4];
-    uint8_t prg_rom_pages;
-    uint8_t chr_rom_pages;
-    uint8_t mapper1;
-    uint8_t mapper2;
-    uint8_t prg_ram_pages;
-    uint8_t tv_system1;
-    uint8_t tv_system2;
-    char unused[5];
+    uint8_t prg_rom_pages; // 16KB units, LSB in NES 2.0
+    uint8_t chr_rom_pages; // 8KB units, LSB in NES 2.0
+    uint8_t mapper1;       // Mirroring, battery, trainer, mapper bits 0-3
+    uint8_t mapper2;       // Console type, NES 2.0 marker, mapper bits 4-7
+    uint8_t prg_ram_pages; // iNES: PRG-RAM in 8KB units. NES 2.0: mapper bits 8-11, submapper
+    uint8_t tv_system1;    // iNES: TV system. NES 2.0: PRG/CHR-ROM size MSBs
+    uint8_t tv_system2;    // iNES: unofficial. NES 2.0: PRG-RAM/NVRAM size shifts
+    uint8_t chr_ram;       // NES 2.0: CHR-RAM/NVRAM size shifts
+    uint8_t timing;        // NES 2.0: CPU/PPU timing
+    char unused[3];
 };
 
-typedef enum MirroringType {
-    HORIZONTAL,
-    VERTICAL,
-    ONESCREEN_LO,
-    ONESCREEN_HI,
-} MirroringType;
+#define CHR_RAM_SIZE (8 * 1024)
+#define PRG_RAM_SIZE (8 * 1024)
+
+// $8000-$FFFF is seen through four 8KB PRG slots and the PPU's $0000-$1FFF through eight 1KB CHR slots
+#define PRG_BANK_SIZE (8 * 1024)
+#define PRG_SLOTS 4
+#define CHR_BANK_SIZE 1024
+#define CHR_SLOTS 8
 
 struct Cartridge {
     uint8_t (*cpu_read)(uint16_t addr);
@@ -38,10 +66,20 @@ struct Cartridge {
     uint8_t (*ppu_read)(uint16_t addr);
     void (*ppu_write)(uint16_t addr, uint8_t data);
 
-    uint8_t *pgr;
-    uint8_t *chr;
+    uint8_t *rom; // Read-only mapping of the whole rom file
+    size_t rom_size;
+    const uint8_t *pgr;
+    uint8_t *chr; // Points into the rom mapping unless chr_ram
     uint32_t pgr_size;
     uint32_t chr_size;
+    bool chr_ram;
+    uint8_t *prg_ram;      // Mapped from the .sav file when the board has a battery
+    uint8_t *prg_ram_bank; // 8KB seen at $6000-$7FFF
+    uint32_t prg_ram_size;
+    bool prg_ram_enabled;
+    BatterySave *save;     // nullptr without battery
+    const uint8_t *prg_banks[PRG_SLOTS]; // Set by the mapper, read directly by the bus
+    uint8_t *chr_banks[CHR_SLOTS];       // Set by the mapper, read directly by the PPU; writable only if chr_ram
     Mapper *mapper;
     CartridgeInfo *info;
     MirroringType mirror;
@@ -49,5 +87,24 @@ struct Cartridge {
 
 Cartridge *cartridge_new(const char *path);
 void cartridge_free(Cartridge *cart);
+Cartridge *cartridge_clone(const Cartridge *src);
+void cartridge_free_clone(Cartridge *clone);
+void cartridge_copy_state(Cartridge *dst, const Cartridge *src);
+void cartridge_bind(Cartridge *c);
+
+void cart_set_mirror(MirroringType mirror);
+void cart_set_prg_ram_enabled(bool enabled);
+const uint8_t *cart_prg_page(uint16_t addr);
+uint32_t cart_prg_offset(uint16_t addr);
+
+// Bank switching for mappers. Bank numbers wrap around the rom size and negative ones count from the end, -1 is the
+// last bank.
+void cart_map_prg_8k(uint8_t slot, int32_t bank);
+void cart_map_prg_16k(uint8_t slot, int32_t bank);
+void cart_map_prg_32k(int32_t bank);
+void cart_map_prg_ram(int32_t bank);
+void cart_map_chr_1k(uint8_t slot, int32_t bank);
+void cart_map_chr_4k(uint8_t slot, int32_t bank);
+void cart_map_chr_8k(int32_t bank);
 
 #endif // CARTRIDGE_H
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cdl.h"
+
+Cdl *cdl;
+
+// Flags of a log written for the rom with this hash and PRG size, nullptr if the file isn't one. The CHR flags follow
+// the PRG ones, *chr_size of them.
+uint8_t *cdl_load(const char *path, const uint32_t crc32, const uint32_t prg_size, uint32_t *chr_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", path);
+        return nullptr;
+    }
+    CdlHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CDL_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CDL_VERSION) {
+        fprintf(stderr, "Error reading %s, not a version %d code/data log.\n", path, CDL_VERSION);
+        fclose(file);
+        return nullptr;
+    }
+    if (header.crc32 != crc32 || header.prg_size != prg_size) {
+        fprintf(stderr, "Error reading %s, it was logged for another rom (CRC32 %08X).\n", path, header.crc32);
+        fclose(file);
+        return nullptr;
+    }
+    const size_t size = (size_t)prg_size + header.chr_size;
+    uint8_t *flags = malloc(size);
+    if (fread(flags, 1, size, file) != size) {
+        fprintf(stderr, "Error reading %s, the log is cut short.\n", path);
+        free(flags);
+        fclose(file);
+        return nullptr;
+    }
+    fclose(file);
+    *chr_size = header.chr_size;
+    return flags;
+}
+
+// Starts logging the cartridge's PRG and CHR use, carrying on from `path` when it already holds a log of the same
+// rom. Another rom's log is left alone and nothing is logged.
+bool cdl_start(const char *path, const Cartridge *cart) {
+    cdl_stop();
+    uint8_t *flags;
+    FILE *existing = fopen(path, "rb");
+    if (existing != nullptr) {
+        fclose(existing);
+        uint32_t chr_size;
+        flags = cdl_load(path, cart->info->crc32, cart->pgr_size, &chr_size);
+        if (flags == nullptr)
+            return false;
+        if (chr_size != cart->chr_size) {
+            fprintf(stderr, "Error reading %s, it was logged with %u bytes of CHR, not %u.\n", path, chr_size,
+                    cart->chr_size);
+            free(flags);
+            return false;
+        }
+    } else {
+        flags = calloc((size_t)cart->pgr_size + cart->chr_size, 1);
+    }
+    cdl = calloc(1, sizeof(Cdl));
+    cdl->prg = flags;
+    cdl->chr = flags + cart->pgr_size;
+    cdl->prg_size = cart->pgr_size;
+    cdl->chr_size = cart->chr_size;
+    cdl->crc32 = cart->info->crc32;
+    cdl->path = strdup(path);
+    return true;
+}
+
+bool cdl_save(void) {
+    if (cdl == nullptr)
+        return false;
+    FILE *file = fopen(cdl->path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", cdl->path);
+        return false;
+    }
+    CdlHeader header = {.version = CDL_VERSION, .crc32 = cdl->crc32, .prg_size = cdl->prg_size,
+                        .chr_size = cdl->chr_size};
+    memcpy(header.magic, CDL_MAGIC, sizeof(header.magic));
+    const size_t size = (size_t)cdl->prg_size + cdl->chr_size;
+    const bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(cdl->prg, 1, size, file) == size;
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Error writing %s.\n", cdl->path);
+        return false;
+    }
+
+    uint32_t code = 0, data = 0, rendered = 0, read = 0;
+    for (uint32_t i = 0; i < cdl->prg_size; i++) {
+        code += (cdl->prg[i] & (CDL_CODE | CDL_OPERAND)) != 0;
+        data += (cdl->prg[i] & (CDL_CODE | CDL_OPERAND | CDL_DATA)) == CDL_DATA;
+    }
+    for (uint32_t i = 0; i < cdl->chr_size; i++) {
+        rendered += (cdl->chr[i] & CDL_RENDERED) != 0;
+        read += (cdl->chr[i] & CDL_READ) != 0;
+    }
+    fprintf(stderr, "Code/data log written to %s: PRG %u code, %u data, %u unseen; CHR %u rendered, %u read.\n",
+            cdl->path, code, data, cdl->prg_size - code - data, rendered, read);
+    return true;
+}
+
+void cdl_stop(void) {
+    if (cdl == nullptr)
+        return;
+    free(cdl->prg);
+    free(cdl->path);
+    free(cdl);
+    cdl = nullptr;
+}
@@ -0,0 +1,62 @@
+#ifndef CDL_H
+#define CDL_H
+
+#include <stdint.h>
+
+#include "cartridge.h"
+
+// Code/data log: one byte of flags per PRG-ROM and per CHR byte, saying how the game used it. The CPU marks opcodes,
+// operands, data reads and the targets of indirect jumps, the PPU the pattern bytes it renders and the ones read
+// through $2007. A log builds up over sessions, an existing file for the same rom is loaded and added to. It tells
+// tools/znes_recomp.c where code is that its walk can't reach and the debugger's disassembly where data is.
+
+#define CDL_MAGIC "ZCDL"
+#define CDL_VERSION 1
+
+// PRG-ROM
+#define CDL_CODE 0x01     // An instruction starts here
+#define CDL_OPERAND 0x02  // Operand byte of one
+#define CDL_DATA 0x04     // Read by an instruction, a JMP (ind) or an interrupt, immediates excluded
+#define CDL_INDIRECT 0x08 // Jumped to through a pointer, a vector or the stack: JMP (ind), interrupts, RTS, RTI
+
+// CHR
+#define CDL_RENDERED 0x01 // Fetched while rendering the background or sprites
+#define CDL_READ 0x02     // Read by the CPU through $2007
+
+// File header, the PRG flags then the CHR ones follow
+typedef struct CdlHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t crc32; // PRG + CHR-ROM, CartridgeInfo's
+    uint32_t prg_size;
+    uint32_t chr_size; // CHR-ROM or CHR-RAM
+} CdlHeader;
+
+typedef struct Cdl {
+    uint8_t *prg;
+    uint8_t *chr; // Right after prg, both are written at once
+    uint32_t prg_size;
+    uint32_t chr_size;
+    uint32_t crc32;
+    char *path;
+} Cdl;
+
+extern Cdl *cdl;
+
+bool cdl_start(const char *path, const Cartridge *cart);
+bool cdl_save(void);
+void cdl_stop(void);
+uint8_t *cdl_load(const char *path, uint32_t crc32, uint32_t prg_size, uint32_t *chr_size);
+
+// Flags only ever get ORed in, without testing what's there. Below $8000 isn't PRG-ROM: the flags are masked to
+// nothing and land on a byte of the bank in slot (addr >> 13) & 3, so callers don't have to branch on the address.
+static inline void cdl_prg(const Cartridge *cart, const uint16_t addr, const uint8_t flags) {
+    const uint32_t offset = (uint32_t)(cart->prg_banks[(addr >> 13) & 0x03] - cart->pgr) + (addr & 0x1FFF);
+    cdl->prg[offset] |= flags & -(addr >> 15);
+}
+
+static inline void cdl_chr(const Cartridge *cart, const uint16_t addr, const uint8_t flags) {
+    cdl->chr[(uint32_t)(cart->chr_banks[(addr >> 10) & 0x07] - cart->chr) + (addr & 0x03FF)] |= flags;
+}
+
+#endif // CDL_H
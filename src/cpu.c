@@ -6,17 +6,35 @@
 #include "bus.h"
 #include "cpu.h"
 #include "forward.h"
+#include "profiler.h"
 #include <string.h>
 
+#include "cartridge.h"
+#include "cdl.h"
+#include "recomp.h"
+#include "scheduler.h"
+#include "trace.h"
+
+#define RAM_OPS 0x0800
+#define RAM_PAGE_OPS 0x0100
+
 Cpu *cpu_new(Bus *bus) {
     cpu = calloc(1, sizeof(Cpu));
     cpu->bus = bus;
     cpu->read = &cpu_read;
     cpu->write = &cpu_write;
+    cpu->ram_ops = calloc(RAM_OPS, sizeof(DecodedOp));
+    for (int i = 0; i < 256; i++)
+        nz_flags[i] = (i == 0 ? Z : 0) | (i & N);
+#ifndef ZNES_PROFILE
+    cpu->idle_skip = true; // A profile should see the loops it's there to find
+#endif
     return cpu;
 }
 
 void cpu_free(Cpu *cpu_) {
+    free(cpu_->rom_ops);
+    free(cpu_->ram_ops);
     free(cpu_);
     cpu = nullptr;
 }
@@ -27,6 +45,14 @@ inline uint8_t cpu_read(const uint16_t addr) { return cpu->bus->read(addr); }
 
 inline void cpu_write(const uint16_t addr, const uint8_t data) { cpu->bus->write(addr, data); }
 
+// For the code/data log: a jump through the pointer at lo and hi, the two bytes it was read from, lands on target
+void cdl_jump(const uint16_t lo, const uint16_t hi, const uint16_t target) {
+    const Cartridge *cart = cpu->bus->cart;
+    cdl_prg(cart, lo, CDL_DATA);
+    cdl_prg(cart, hi, CDL_DATA);
+    cdl_prg(cart, target, CDL_INDIRECT);
+}
+
 uint8_t IMP(void) {
     fetched = cpu->a;
     return 0;
@@ -116,6 +142,8 @@ uint8_t IND(void) {
     } else {
         addr = cpu_read(ptr + 1) << 8 | cpu_read(ptr);
     }
+    if (cdl != nullptr)
+        cdl_jump(ptr, lo == 0x00FF ? ptr & 0xFF00 : ptr + 1, addr);
 
     return 0;
 }
@@ -145,24 +173,27 @@ uint8_t IZY(void) {
     return 0;
 }
 
-uint8_t ADC(void) {
-    cpu_fetch();
-    result = fetched + (uint16_t)cpu->a + get_carry_word();
+// A + value + C into A, what ADC and SBC, with the value inverted, share
+void add_to_acc(const uint8_t value) {
+    result = value + (uint16_t)cpu->a + get_carry_word();
     update_carry_flag(result);
-    update_zero_flag(result);
-    const uint16_t part1 = ~((uint16_t)cpu->a ^ (uint16_t)fetched);
+    set_nz(result);
+    const uint16_t part1 = ~((uint16_t)cpu->a ^ (uint16_t)value);
     const uint16_t part2 = (uint16_t)cpu->a ^ result;
     set_overflow_value(part1 & part2 & 0x0080);
-    update_negative_flag(result);
     set_acc(result);
+}
+
+uint8_t ADC(void) {
+    cpu_fetch();
+    add_to_acc(fetched);
     return 1;
 }
 
 uint8_t AND(void) {
     cpu_fetch();
     cpu->a = cpu->a & fetched;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 1;
 }
 
@@ -170,8 +201,7 @@ uint8_t ASL(void) {
     cpu_fetch();
     result = (uint16_t)fetched << 1;
     update_carry_flag(result);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     set_value(result);
     return 0;
 }
@@ -197,9 +227,7 @@ uint8_t BEQ(void) {
 uint8_t BIT(void) {
     cpu_fetch();
     result = fetched & (uint16_t)cpu->a;
-    update_zero_flag(result);
-    set_negative_value(fetched & (1 << 7));
-    set_overflow_value(fetched & (1 << 6));
+    cpu->status = (cpu->status & ~(Z | N | V)) | (nz_flags[result] & Z) | (fetched & (N | V));
     return 0;
 }
 
@@ -222,11 +250,12 @@ uint8_t BPL(void) {
 }
 
 uint8_t BRK(void) {
-    cpu->pc++;
-    set_interrupt();
-    push_word(cpu->pc);
+    push_word(cpu->pc); // IMM already stepped over the padding byte
     push_byte(cpu->status | B);
+    set_interrupt();
     cpu->pc = (uint16_t)cpu_read(0xFFFE) | ((uint16_t)cpu_read(0xFFFF) << 8);
+    if (cdl != nullptr)
+        cdl_jump(0xFFFE, 0xFFFF, cpu->pc);
     return 0;
 }
 
@@ -266,8 +295,7 @@ uint8_t CMP(void) {
     cpu_fetch();
     result = (uint16_t)cpu->a - (uint16_t)fetched;
     set_carry_value(cpu->a >= fetched);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     return 1;
 }
 
@@ -275,8 +303,7 @@ uint8_t CPX(void) {
     cpu_fetch();
     result = (uint16_t)cpu->x - (uint16_t)fetched;
     set_carry_value(cpu->x >= fetched);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     return 0;
 }
 
@@ -284,39 +311,34 @@ uint8_t CPY(void) {
     cpu_fetch();
     result = (uint16_t)cpu->y - (uint16_t)fetched;
     set_carry_value(cpu->y >= fetched);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     return 0;
 }
 
 uint8_t DEC(void) {
     cpu_fetch();
     result = fetched - 1;
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     cpu_write(addr, result & 0x00FF);
     return 0;
 }
 
 uint8_t DEX(void) {
     cpu->x--;
-    update_zero_flag(cpu->x);
-    update_negative_flag(cpu->x);
+    set_nz(cpu->x);
     return 0;
 }
 
 uint8_t DEY(void) {
     cpu->y--;
-    update_zero_flag(cpu->y);
-    update_negative_flag(cpu->y);
+    set_nz(cpu->y);
     return 0;
 }
 
 uint8_t EOR(void) {
     cpu_fetch();
     cpu->a = cpu->a ^ fetched;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 1;
 }
 
@@ -324,22 +346,19 @@ uint8_t INC(void) {
     cpu_fetch();
     result = fetched + 1;
     cpu_write(addr, result & 0x00FF);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     return 0;
 }
 
 uint8_t INX(void) {
     cpu->x++;
-    update_zero_flag(cpu->x);
-    update_negative_flag(cpu->x);
+    set_nz(cpu->x);
     return 0;
 }
 
 uint8_t INY(void) {
     cpu->y++;
-    update_zero_flag(cpu->y);
-    update_negative_flag(cpu->y);
+    set_nz(cpu->y);
     return 0;
 }
 
@@ -358,24 +377,21 @@ uint8_t JSR(void) {
 uint8_t LDA(void) {
     cpu_fetch();
     cpu->a = fetched;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 1;
 }
 
 uint8_t LDX(void) {
     cpu_fetch();
     cpu->x = fetched;
-    update_zero_flag(cpu->x);
-    update_negative_flag(cpu->x);
+    set_nz(cpu->x);
     return 1;
 }
 
 uint8_t LDY(void) {
     cpu_fetch();
     cpu->y = fetched;
-    update_zero_flag(cpu->y);
-    update_negative_flag(cpu->y);
+    set_nz(cpu->y);
     return 1;
 }
 
@@ -383,31 +399,21 @@ uint8_t LSR(void) {
     cpu_fetch();
     set_carry_value(fetched & 0x01);
     result = fetched >> 1;
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     set_value(result);
     return 0;
 }
 
+// The unofficial ones with an operand still read it, only the abs,X ones can cross a page
 uint8_t NOP(void) {
-    switch (cpu->opcode) {
-        case 0x1C:
-        case 0x3C:
-        case 0x5C:
-        case 0x7C:
-        case 0xDC:
-        case 0xFC:
-            return 1;
-        default:
-            return 0;
-    }
+    cpu_fetch();
+    return 1;
 }
 
 uint8_t ORA(void) {
     cpu_fetch();
     cpu->a = cpu->a | fetched;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 1;
 }
 
@@ -425,8 +431,7 @@ uint8_t PHP(void) {
 
 uint8_t PLA(void) {
     cpu->a = pop_byte();
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 0;
 }
 
@@ -440,8 +445,7 @@ uint8_t ROL(void) {
     cpu_fetch();
     result = get_carry_word() | ((uint16_t)fetched << 1);
     update_carry_flag(result);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     set_value(result);
     return 0;
 }
@@ -450,8 +454,7 @@ uint8_t ROR(void) {
     cpu_fetch();
     result = (get_carry_word() << 7) | (fetched >> 1);
     set_carry_value(fetched & 0x01);
-    update_zero_flag(result);
-    update_negative_flag(result);
+    set_nz(result);
     set_value(result);
     return 0;
 }
@@ -461,26 +464,22 @@ uint8_t RTI(void) {
     cpu->status &= ~B;
     cpu->status &= ~U;
     cpu->pc = pop_word();
+    if (cdl != nullptr)
+        cdl_prg(cpu->bus->cart, cpu->pc, CDL_INDIRECT);
     return 0;
 }
 
 uint8_t RTS(void) {
     cpu->pc = pop_word();
     cpu->pc++;
+    if (cdl != nullptr)
+        cdl_prg(cpu->bus->cart, cpu->pc, CDL_INDIRECT);
     return 0;
 }
 
 uint8_t SBC(void) {
     cpu_fetch();
-    const uint16_t value = ((uint16_t)fetched) ^ 0x00FF;
-    result = (uint16_t)cpu->a + value + get_carry_word();
-    update_carry_flag(result);
-    update_zero_flag(result);
-    const uint16_t part1 = (result ^ (uint16_t)cpu->a);
-    const uint16_t part2 = (result ^ value);
-    set_overflow_value(part1 & part2 & 0x0080);
-    update_negative_flag(result);
-    set_acc(result);
+    add_to_acc(fetched ^ 0xFF);
     return 1;
 }
 
@@ -516,29 +515,25 @@ uint8_t STY(void) {
 
 uint8_t TAX(void) {
     cpu->x = cpu->a;
-    update_zero_flag(cpu->x);
-    update_negative_flag(cpu->x);
+    set_nz(cpu->x);
     return 0;
 }
 
 uint8_t TAY(void) {
     cpu->y = cpu->a;
-    update_zero_flag(cpu->y);
-    update_negative_flag(cpu->y);
+    set_nz(cpu->y);
     return 0;
 }
 
 uint8_t TSX(void) {
     cpu->x = cpu->sp;
-    update_zero_flag(cpu->x);
-    update_negative_flag(cpu->x);
+    set_nz(cpu->x);
     return 0;
 }
 
 uint8_t TXA(void) {
     cpu->a = cpu->x;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
     return 0;
 }
 
@@ -549,34 +544,541 @@ uint8_t TXS(void) {
 
 uint8_t TYA(void) {
     cpu->a = cpu->y;
-    update_zero_flag(cpu->a);
-    update_negative_flag(cpu->a);
+    set_nz(cpu->a);
+    return 0;
+}
+
+uint8_t ALR(void) {
+    cpu_fetch();
+    cpu->a &= fetched;
+    set_carry_value(cpu->a & 0x01);
+    cpu->a >>= 1;
+    set_nz(cpu->a);
     return 0;
 }
 
+uint8_t ANC(void) {
+    cpu_fetch();
+    cpu->a &= fetched;
+    set_nz(cpu->a);
+    set_carry_value(cpu->a & 0x80);
+    return 0;
+}
+
+uint8_t ARR(void) {
+    cpu_fetch();
+    cpu->a = (uint8_t)(get_carry() << 7) | (cpu->a & fetched) >> 1;
+    set_nz(cpu->a);
+    set_carry_value(cpu->a & 0x40);
+    set_overflow_value(((cpu->a >> 6) ^ (cpu->a >> 5)) & 0x01);
+    return 0;
+}
+
+uint8_t AXS(void) {
+    cpu_fetch();
+    const uint8_t value = cpu->a & cpu->x;
+    set_carry_value(value >= fetched);
+    cpu->x = value - fetched;
+    set_nz(cpu->x);
+    return 0;
+}
+
+uint8_t DCP(void) {
+    cpu_fetch();
+    const uint8_t value = fetched - 1;
+    cpu_write(addr, value);
+    result = (uint16_t)cpu->a - value;
+    set_carry_value(cpu->a >= value);
+    set_nz(result);
+    return 0;
+}
+
+uint8_t ISC(void) {
+    cpu_fetch();
+    const uint8_t value = fetched + 1;
+    cpu_write(addr, value);
+    add_to_acc(value ^ 0xFF);
+    return 0;
+}
+
+uint8_t LAX(void) {
+    cpu_fetch();
+    cpu->a = fetched;
+    cpu->x = fetched;
+    set_nz(cpu->a);
+    return 1;
+}
+
+uint8_t RLA(void) {
+    cpu_fetch();
+    const uint8_t value = (uint8_t)(fetched << 1) | get_carry();
+    set_carry_value(fetched & 0x80);
+    cpu_write(addr, value);
+    cpu->a &= value;
+    set_nz(cpu->a);
+    return 0;
+}
+
+uint8_t RRA(void) {
+    cpu_fetch();
+    const uint8_t value = (uint8_t)(get_carry() << 7) | fetched >> 1;
+    set_carry_value(fetched & 0x01);
+    cpu_write(addr, value);
+    add_to_acc(value);
+    return 0;
+}
+
+uint8_t SAX(void) {
+    cpu_write(addr, cpu->a & cpu->x);
+    return 0;
+}
+
+uint8_t SLO(void) {
+    cpu_fetch();
+    const uint8_t value = fetched << 1;
+    set_carry_value(fetched & 0x80);
+    cpu_write(addr, value);
+    cpu->a |= value;
+    set_nz(cpu->a);
+    return 0;
+}
+
+uint8_t SRE(void) {
+    cpu_fetch();
+    const uint8_t value = fetched >> 1;
+    set_carry_value(fetched & 0x01);
+    cpu_write(addr, value);
+    cpu->a ^= value;
+    set_nz(cpu->a);
+    return 0;
+}
+
+// Jams and the unstable opcodes run as NOPs. Reported the 1st, 2nd, 4th, 8th... time each one runs, a game that keeps
+// hitting one shouldn't cost a write to stderr per instruction.
 uint8_t ZZZ(void) {
-    fprintf(stderr, "Unknown opcode: %02X (%d) at [%04X]\n", cpu->opcode, cpu->opcode, cpu->pc - 1);
-    // exit(1);
+    const uint64_t count = ++cpu->unknown_opcodes[cpu->opcode];
+    if ((count & (count - 1)) != 0)
+        return 0;
+    if (count == 1)
+        trace_dump("unknown opcode");
+    const Instruction *inst = &lut[cpu->opcode];
+    const uint8_t length = inst->mode == &IMP ? 1 : inst->mode == &IMM || inst->mode == &IZY ? 2 : 3;
+    fprintf(stderr, "Unknown opcode: %02X (%d) at [%04X], run %llu times\n", cpu->opcode, cpu->opcode,
+            (uint16_t)(cpu->pc - length), (unsigned long long)count);
+    return 0;
+}
+
+// Addressing modes for decoded ops: the same as the ones above, with the operand bytes already in `decoded` and the PC
+// already past them
+
+uint8_t cached_IMM(void) {
+    addr = cpu->pc - 1;
+    return 0;
+}
+
+uint8_t cached_ZP0(void) {
+    addr = decoded->operand;
+    return 0;
+}
+
+uint8_t cached_ZPX(void) {
+    addr = (decoded->operand + cpu->x) & 0x00FF;
     return 0;
 }
 
+uint8_t cached_ZPY(void) {
+    addr = (decoded->operand + cpu->y) & 0x00FF;
+    return 0;
+}
+
+uint8_t cached_REL(void) {
+    branch_addr = decoded->operand;
+    return 0;
+}
+
+uint8_t cached_ABS(void) {
+    addr = decoded->operand;
+    return 0;
+}
+
+uint8_t cached_ABX(void) {
+    addr = decoded->operand + cpu->x;
+    return (addr & 0xFF00) != (decoded->operand & 0xFF00);
+}
+
+uint8_t cached_ABY(void) {
+    addr = decoded->operand + cpu->y;
+    return (addr & 0xFF00) != (decoded->operand & 0xFF00);
+}
+
+uint8_t cached_IND(void) {
+    const uint16_t ptr = decoded->operand;
+    if ((ptr & 0x00FF) == 0x00FF) {
+        addr = cpu_read(ptr & 0xFF00) << 8 | cpu_read(ptr);
+    } else {
+        addr = cpu_read(ptr + 1) << 8 | cpu_read(ptr);
+    }
+    if (cdl != nullptr)
+        cdl_jump(ptr, (ptr & 0x00FF) == 0x00FF ? ptr & 0xFF00 : ptr + 1, addr);
+    return 0;
+}
+
+uint8_t cached_IZX(void) {
+    const uint16_t ptr = decoded->operand;
+    const uint16_t lo = cpu_read((ptr + (uint16_t)cpu->x) & 0x00FF);
+    const uint16_t hi = cpu_read((ptr + (uint16_t)cpu->x + 1) & 0x00FF);
+    addr = hi << 8 | lo;
+    return 0;
+}
+
+uint8_t cached_IZY(void) {
+    const uint16_t ptr = decoded->operand;
+    const uint16_t lo = cpu_read(ptr & 0x00FF);
+    const uint16_t hi = cpu_read((ptr + 1) & 0x00FF);
+    addr = hi << 8 | lo;
+    addr += cpu->y;
+    if ((addr & 0xFF00) != hi << 8)
+        return 1;
+    return 0;
+}
+
+// Called on a new cartridge, its PRG-ROM gets a fresh set of ops, with the translated ones when znes-recomp made a
+// module for it
+void cpu_set_cart(const Cartridge *cart) {
+    free(cpu->rom_ops);
+    cpu->rom_ops = calloc(cart->pgr_size, sizeof(DecodedOp));
+
+    const RecompiledRom *rom = recomp_find(cart);
+    if (rom == nullptr)
+        return;
+    for (uint32_t i = 0; i < rom->count; i++)
+        cpu->rom_ops[rom->ops[i].offset].run = rom->ops[i].run;
+}
+
+// Decoded op for the instruction at pc, nullptr where code isn't cached: $6000-$7FFF, the last two bytes of a PRG
+// slot whose operand would come from the next slot, which can be switched on its own, and the end of RAM where it
+// would come from the PPU registers
+DecodedOp *decoded_op(const uint16_t pc) {
+    if (pc >= 0x8000) {
+        if ((pc & 0x1FFF) > 0x1FFD)
+            return nullptr;
+        const Cartridge *cart = cpu->bus->cart;
+        return &cpu->rom_ops[cart->prg_banks[(pc >> 13) & 0x03] - cart->pgr + (pc & 0x1FFF)];
+    }
+    if (pc <= 0x1FFD)
+        return &cpu->ram_ops[pc & (RAM_OPS - 1)];
+    return nullptr;
+}
+
+void decode_op(DecodedOp *op, const uint16_t pc) {
+    op->opcode = cpu_read(pc);
+    const Instruction *inst = &lut[op->opcode];
+    op->exec = inst->exec;
+    op->cycles = inst->cycles;
+    op->operand = 0x0000;
+    op->length = 2;
+
+    const uint8_t lo = inst->mode == &IMP ? 0x00 : cpu_read(pc + 1);
+    if (inst->mode == &IMP) {
+        op->mode = &IMP;
+        op->length = 1;
+    } else if (inst->mode == &IMM) {
+        op->mode = &cached_IMM;
+    } else if (inst->mode == &ZP0) {
+        op->mode = &cached_ZP0;
+        op->operand = lo;
+    } else if (inst->mode == &ZPX) {
+        op->mode = &cached_ZPX;
+        op->operand = lo;
+    } else if (inst->mode == &ZPY) {
+        op->mode = &cached_ZPY;
+        op->operand = lo;
+    } else if (inst->mode == &IZX) {
+        op->mode = &cached_IZX;
+        op->operand = lo;
+    } else if (inst->mode == &IZY) {
+        op->mode = &cached_IZY;
+        op->operand = lo;
+    } else if (inst->mode == &REL) {
+        op->mode = &cached_REL;
+        op->operand = lo & 0x80 ? 0xFF00 | lo : lo;
+    } else {
+        op->mode = inst->mode == &ABS ? &cached_ABS
+                   : inst->mode == &ABX ? &cached_ABX
+                   : inst->mode == &ABY ? &cached_ABY
+                                        : &cached_IND;
+        op->operand = (uint16_t)(cpu_read(pc + 2) << 8) | lo;
+        op->length = 3;
+    }
+
+    if (pc <= 0x1FFF) {
+        for (uint8_t i = 0; i < op->length; i++)
+            cpu->code_pages |= 1 << (((pc + i) >> 8) & 0x07);
+    }
+}
+
+// Marks the instruction at pc as code and the one or two bytes after it as operands, if it's in PRG-ROM
+void cdl_step(const uint16_t pc, const DecodedOp *op) {
+    if (pc < 0x8000)
+        return;
+    DecodedOp undecoded;
+    if (op == nullptr) {
+        decode_op(&undecoded, pc);
+        op = &undecoded;
+    }
+    const Cartridge *cart = cpu->bus->cart;
+    cdl_prg(cart, pc, CDL_CODE);
+    cdl_prg(cart, pc + 1, op->length > 1 ? CDL_OPERAND : 0);
+    cdl_prg(cart, pc + 2, op->length > 2 ? CDL_OPERAND : 0);
+}
+
+// A write to a RAM page with decoded code: drop the ops in it and the two before it, whose operands may reach in
+void cpu_invalidate_ram(const uint16_t addr) {
+    const uint16_t page = addr & (RAM_OPS - 1) & 0xFF00;
+    memset(&cpu->ram_ops[page], 0, RAM_PAGE_OPS * sizeof(DecodedOp));
+    cpu->ram_ops[(page - 1) & (RAM_OPS - 1)].length = 0;
+    cpu->ram_ops[(page - 2) & (RAM_OPS - 1)].length = 0;
+    cpu->code_pages &= ~(1 << (page >> 8));
+}
+
+// Loops with a jump back of at most this many bytes are watched for idling
+#define IDLE_MAX_BYTES 16
+
+void idle_snapshot(IdleStep *step) {
+    step->pc = cpu->pc;
+    step->a = cpu->a;
+    step->x = cpu->x;
+    step->y = cpu->y;
+    step->sp = cpu->sp;
+    step->status = cpu->status;
+    step->opcode = cpu->opcode;
+}
+
+void idle_restore(const IdleStep *step) {
+    cpu->pc = step->pc;
+    cpu->a = step->a;
+    cpu->x = step->x;
+    cpu->y = step->y;
+    cpu->sp = step->sp;
+    cpu->status = step->status;
+    cpu->opcode = step->opcode;
+}
+
+// RAM and the cartridge read the same until something writes them. A $2002 read with VBlank clear only resets the
+// w latch, which the read of the watched iteration already did; the value is redone on a status change.
+uint8_t idle_watch_read(const uint16_t addr) {
+    IdleLoop *loop = &cpu->idle_loop;
+    const uint8_t data = loop->read(addr);
+    if (addr >= 0x2000 && addr <= 0x3FFF && (addr & 0x0007) == 0x0002 && !(data & 0x80))
+        loop->polls_ppu = true;
+    else if (addr >= 0x2000 && addr <= 0x5FFF)
+        loop->pure = false;
+    return data;
+}
+
+void idle_watch_write(const uint16_t addr, const uint8_t data) {
+    cpu->idle_loop.write(addr, data);
+    cpu->idle_loop.pure = false;
+}
+
+// Starts watching the iteration beginning at the current PC
+void idle_watch_start(const uint16_t tail) {
+    IdleLoop *loop = &cpu->idle_loop;
+    if (!loop->watching) {
+        loop->read = cpu->bus->read;
+        loop->write = cpu->bus->write;
+        cpu->bus->read = &idle_watch_read;
+        cpu->bus->write = &idle_watch_write;
+        loop->watching = true;
+    }
+    loop->head = cpu->pc;
+    loop->tail = tail;
+    idle_snapshot(&loop->start);
+    loop->step_count = 0;
+    loop->period = 0;
+    loop->pure = true;
+    loop->polls_ppu = false;
+}
+
+void idle_watch_stop(void) {
+    IdleLoop *loop = &cpu->idle_loop;
+    if (!loop->watching)
+        return;
+    cpu->bus->read = loop->read;
+    cpu->bus->write = loop->write;
+    loop->watching = false;
+}
+
+// Records the instruction that just ran from pc, cpu->cycles is its full length
+void idle_watch_step(const uint16_t pc) {
+    IdleLoop *loop = &cpu->idle_loop;
+    // Outside the loop body this is the way out of the loop, not an iteration
+    if (pc < loop->head || pc > loop->tail || loop->step_count == IDLE_MAX_STEPS) {
+        idle_watch_stop();
+        return;
+    }
+    if (!loop->pure) {
+        loop->rejected = loop->head;
+        idle_watch_stop();
+        return;
+    }
+    IdleStep *step = &loop->steps[loop->step_count++];
+    idle_snapshot(step);
+    step->offset = loop->period;
+    step->cycles = cpu->cycles;
+    loop->period += cpu->cycles;
+}
+
+// Back at the head: the iteration is a no-op if it came back to the state it started in
+bool idle_loop_repeats(void) {
+    const IdleLoop *loop = &cpu->idle_loop;
+    const IdleStep *start = &loop->start;
+    return loop->pure && cpu->a == start->a && cpu->x == start->x && cpu->y == start->y && cpu->sp == start->sp &&
+           cpu->status == start->status;
+}
+
+// Step of the skipped loop the CPU has reached by now, *left set to the cycles that step still has to run
+const IdleStep *idle_current(uint8_t *left) {
+    const IdleLoop *loop = &cpu->idle_loop;
+    // CPU cycles fall on clock_count multiples of 3, starting with `since`
+    const uint32_t elapsed = (cpu->bus->clock_count - loop->since + 2) / 3;
+    if (elapsed == 0) {
+        *left = 0;
+        return &loop->start;
+    }
+    const uint32_t cycle = (elapsed - 1) % loop->period;
+    uint8_t i = 0;
+    while (cycle >= loop->steps[i].offset + loop->steps[i].cycles)
+        i++;
+    *left = loop->steps[i].cycles - 1 - (cycle - loop->steps[i].offset);
+    return &loop->steps[i];
+}
+
+// Brings an idle CPU up to the current clock: the state after the last instruction the loop would have started, with
+// the cycles it has left
+void cpu_wake(void) {
+    if (!cpu->idle)
+        return;
+    cpu->idle = false;
+    uint8_t left;
+    idle_restore(idle_current(&left));
+    cpu->cycles = left;
+}
+
+// Registers as they would be had the CPU kept running, for display: an idle CPU's own are from the start of the loop.
+// Unlike cpu_wake() nothing about the emulation changes.
+IdleStep cpu_registers(void) {
+    if (cpu->idle) {
+        uint8_t left;
+        return *idle_current(&left);
+    }
+    return (IdleStep){.pc = cpu->pc, .a = cpu->a, .x = cpu->x, .y = cpu->y, .sp = cpu->sp, .status = cpu->status,
+                      .opcode = cpu->opcode};
+}
+
+// Records the state before the instruction at pc runs, see trace.h. Operands come from the decoded op; without one
+// they are read from the bus, except for code running from I/O registers where a read could have side effects.
+void trace_step(const uint16_t pc, const DecodedOp *op) {
+    TraceRecord *record = &trace->records[trace->count++ & (TRACE_RECORDS - 1)];
+    record->clock = cpu->bus->scheduler->now;
+    record->pc = pc;
+    record->scanline = *trace->scanline;
+    record->dot = *trace->dot;
+    if (op != nullptr) {
+        record->opcode = op->opcode;
+        // Decoding doesn't keep immediates, they're read when the instruction runs
+        record->operand[0] = op->mode == &cached_IMM ? cpu_read(pc + 1) : op->operand & 0xFF;
+        record->operand[1] = op->operand >> 8;
+    } else if (pc < 0x2000 || pc >= 0x4020) {
+        record->opcode = cpu_read(pc);
+        record->operand[0] = cpu_read(pc + 1);
+        record->operand[1] = cpu_read(pc + 2);
+    } else {
+        record->opcode = 0x00;
+        record->operand[0] = 0x00;
+        record->operand[1] = 0x00;
+    }
+    record->a = cpu->a;
+    record->x = cpu->x;
+    record->y = cpu->y;
+    record->status = cpu->status;
+    record->sp = cpu->sp;
+    if (pc == trace->trigger_pc) {
+        trace->trigger_pc = -1;
+        trace_dump("trigger pc");
+    }
+}
+
 void cpu_clock(void) {
+    if (cpu->idle)
+        return;
+
+    // IRQ is level triggered: taken at the next instruction boundary for as long as a device holds the line
+    if (cpu->cycles == 0 && cpu->irq_line != 0 && get_interrupt() == 0)
+        cpu_irq();
+
     if (cpu->cycles == 0) {
-        cpu->opcode = cpu_read(cpu->pc);
-        set_unused();
-        cpu->pc++;
+        IdleLoop *loop = &cpu->idle_loop;
+        if (loop->watching && cpu->pc == loop->head && loop->step_count > 0) {
+            if (idle_loop_repeats()) {
+                idle_watch_stop();
+                cpu->idle = true;
+                loop->since = cpu->bus->clock_count;
+                return;
+            }
+            idle_watch_start(loop->tail);
+        }
 
-        cpu->cycles = lut[cpu->opcode].cycles;
-        const uint8_t add_cycle1 = lut[cpu->opcode].mode();
-        const uint8_t add_cycle2 = lut[cpu->opcode].exec();
-        cpu->cycles += add_cycle1 & add_cycle2;
+        const uint16_t pc = cpu->pc;
+        DecodedOp *op = decoded_op(pc);
+        if (op != nullptr && op->length == 0)
+            decode_op(op, pc);
+        if (trace != nullptr)
+            trace_step(pc, op);
+        if (cdl != nullptr)
+            cdl_step(pc, op);
+        if (op != nullptr) {
+            decoded = op;
+            cpu->opcode = op->opcode;
+            set_unused();
+            cpu->pc = pc + op->length;
+
+            cpu->cycles = op->cycles;
+            // Translated code reads its operands on its own, the log needs the interpreter's reads
+            if (op->run != nullptr && cdl == nullptr) {
+                const uint8_t add_cycle = op->run();
+                cpu->cycles += add_cycle;
+            } else {
+                const uint8_t add_cycle1 = op->mode();
+                const uint8_t add_cycle2 = op->exec();
+                cpu->cycles += add_cycle1 & add_cycle2;
+            }
+        } else {
+            cpu->opcode = cpu_read(cpu->pc);
+            set_unused();
+            cpu->pc++;
+
+            cpu->cycles = lut[cpu->opcode].cycles;
+            const uint8_t add_cycle1 = lut[cpu->opcode].mode();
+            const uint8_t add_cycle2 = lut[cpu->opcode].exec();
+            cpu->cycles += add_cycle1 & add_cycle2;
+        }
         set_unused();
+        PROFILE_RECORD(pc, cpu->pc, cpu->opcode, cpu->cycles);
+
+        if (loop->watching)
+            idle_watch_step(pc);
+        else if (cpu->pc <= pc && pc - cpu->pc <= IDLE_MAX_BYTES && cpu->idle_skip && cpu->pc != loop->rejected)
+            idle_watch_start(pc);
     }
 
     cpu->cycles--;
 }
 
 void cpu_reset(void) {
+    idle_watch_stop();
+    cpu->idle = false;
+    cpu->idle_loop.rejected = 0x0000;
     cpu->sp = 0xFD;
     cpu->a = 0x00;
     cpu->x = 0x00;
@@ -586,6 +1088,8 @@ void cpu_reset(void) {
     const uint16_t lo = cpu_read(addr);
     const uint16_t hi = cpu_read(addr + 1);
     cpu->pc = hi << 8 | lo;
+    if (cdl != nullptr)
+        cdl_jump(addr, addr + 1, cpu->pc);
     // NESTEST
     // cpu->pc = 0xC000;
     cpu->opcode = 0x00;
@@ -597,34 +1101,49 @@ void cpu_reset(void) {
 
 void cpu_irq(void) {
     if (get_interrupt() == 0) {
+        idle_watch_stop();
         push_word(cpu->pc);
 
         clear_break();
         set_unused();
-        set_interrupt();
         push_byte(cpu->status);
+        set_interrupt();
 
         addr = 0xFFFE;
         const uint16_t lo = cpu_read(addr);
         const uint16_t hi = cpu_read(addr + 1);
         cpu->pc = (hi << 8) | lo;
+        if (cdl != nullptr)
+            cdl_jump(addr, addr + 1, cpu->pc);
 
         cpu->cycles = 7;
     }
 }
 
+void cpu_set_irq(const uint8_t source, const bool asserted) {
+    cpu_wake();
+    if (asserted)
+        cpu->irq_line |= source;
+    else
+        cpu->irq_line &= ~source;
+}
+
 void cpu_nmi(void) {
+    cpu_wake();
+    idle_watch_stop();
     push_word(cpu->pc);
 
     clear_break();
     set_unused();
-    set_interrupt();
     push_byte(cpu->status);
+    set_interrupt();
 
     addr = 0xFFFA;
     const uint16_t lo = cpu_read(addr);
     const uint16_t hi = cpu_read(addr + 1);
     cpu->pc = hi << 8 | lo;
+    if (cdl != nullptr)
+        cdl_jump(addr, addr + 1, cpu->pc);
 
     cpu->cycles = 8;
 }
@@ -632,6 +1151,8 @@ void cpu_nmi(void) {
 uint8_t cpu_fetch(void) {
     if (!(lut[cpu->opcode].mode == &IMP)) {
         fetched = cpu_read(addr);
+        if (cdl != nullptr)
+            cdl_prg(cpu->bus->cart, addr, lut[cpu->opcode].mode == &IMM ? 0 : CDL_DATA);
     }
     return fetched;
 }
@@ -700,61 +1221,21 @@ inline uint16_t get_overflow_word(void) { return (uint16_t)get_overflow(); }
 
 inline uint16_t get_unused_word(void) { return (uint16_t)get_unused(); }
 
-inline void set_carry_value(const bool value) {
-    if (value)
-        set_carry();
-    else
-        clear_carry();
-}
+inline void set_carry_value(const bool value) { cpu->status = (cpu->status & ~C) | value * C; }
 
-inline void set_zero_value(const bool value) {
-    if (value)
-        set_zero();
-    else
-        clear_zero();
-}
+inline void set_zero_value(const bool value) { cpu->status = (cpu->status & ~Z) | value * Z; }
 
-inline void set_interrupt_value(const bool value) {
-    if (value)
-        set_interrupt();
-    else
-        clear_interrupt();
-}
+inline void set_interrupt_value(const bool value) { cpu->status = (cpu->status & ~I) | value * I; }
 
-inline void set_decimal_value(const bool value) {
-    if (value)
-        set_decimal();
-    else
-        clear_decimal();
-}
+inline void set_decimal_value(const bool value) { cpu->status = (cpu->status & ~D) | value * D; }
 
-inline void set_break_value(const bool value) {
-    if (value)
-        set_break();
-    else
-        clear_break();
-}
+inline void set_break_value(const bool value) { cpu->status = (cpu->status & ~B) | value * B; }
 
-inline void set_negative_value(const bool value) {
-    if (value)
-        set_negative();
-    else
-        clear_negative();
-}
+inline void set_negative_value(const bool value) { cpu->status = (cpu->status & ~N) | value * N; }
 
-inline void set_overflow_value(const bool value) {
-    if (value)
-        set_overflow();
-    else
-        clear_overflow();
-}
+inline void set_overflow_value(const bool value) { cpu->status = (cpu->status & ~V) | value * V; }
 
-inline void set_unused_value(const bool value) {
-    if (value)
-        set_unused();
-    else
-        clear_unused();
-}
+inline void set_unused_value(const bool value) { cpu->status = (cpu->status & ~U) | value * U; }
 
 inline void push_word(const uint16_t value) {
     push_byte((value >> 8) & 0xFF);
@@ -777,26 +1258,9 @@ inline uint8_t pop_byte(void) {
     return cpu_read(BASE_STACK + (uint16_t)cpu->sp);
 }
 
-inline void update_zero_flag(const uint16_t value) {
-    if ((value & 0x00FF) == 0)
-        set_zero();
-    else
-        clear_zero();
-}
-
-inline void update_negative_flag(const uint16_t value) {
-    if (value & 0x0080)
-        set_negative();
-    else
-        clear_negative();
-}
+inline void set_nz(const uint8_t value) { cpu->status = (cpu->status & ~(Z | N)) | nz_flags[value]; }
 
-inline void update_carry_flag(const uint16_t value) {
-    if (value & 0xFF00)
-        set_carry();
-    else
-        clear_carry();
-}
+inline void update_carry_flag(const uint16_t value) { cpu->status = (cpu->status & ~C) | (value > 0x00FF) * C; }
 
 inline void set_value(const uint16_t value) {
     if (lut[cpu->opcode].mode == &IMP) {
@@ -929,6 +1393,59 @@ void disasm_addr(Bus *bus, uint16_t addr) {
     printf("%s\n", sInst);
 }
 
+// One instruction from its bytes rather than the bus, for code in banks that aren't mapped right now. Returns the
+// instruction length.
+uint8_t disasm_bytes(const uint16_t pc, const uint8_t *bytes, char *out, const size_t size) {
+    const Instruction *inst = &lut[bytes[0]];
+    const uint16_t word = (uint16_t)(bytes[2] << 8) | bytes[1];
+    if (inst->mode == &IMP) {
+        snprintf(out, size, "%s {IMP}", inst->name);
+        return 1;
+    }
+    if (inst->mode == &IMM)
+        snprintf(out, size, "%s $%02X {IMM}", inst->name, bytes[1]);
+    else if (inst->mode == &ZP0)
+        snprintf(out, size, "%s $%02X {ZP0}", inst->name, bytes[1]);
+    else if (inst->mode == &ZPX)
+        snprintf(out, size, "%s $%02X, X {ZPX}", inst->name, bytes[1]);
+    else if (inst->mode == &ZPY)
+        snprintf(out, size, "%s $%02X, Y {ZPY}", inst->name, bytes[1]);
+    else if (inst->mode == &IZX)
+        snprintf(out, size, "%s ($%02X, X) {IZX}", inst->name, bytes[1]);
+    else if (inst->mode == &IZY)
+        snprintf(out, size, "%s ($%02X), Y {IZY}", inst->name, bytes[1]);
+    else if (inst->mode == &REL)
+        snprintf(out, size, "%s $%02X [$%04X] {REL}", inst->name, bytes[1], (uint16_t)(pc + 2 + (int8_t)bytes[1]));
+    else if (inst->mode == &ABS)
+        snprintf(out, size, "%s $%04X {ABS}", inst->name, word);
+    else if (inst->mode == &ABX)
+        snprintf(out, size, "%s $%04X, X {ABX}", inst->name, word);
+    else if (inst->mode == &ABY)
+        snprintf(out, size, "%s $%04X, Y {ABY}", inst->name, word);
+    else if (inst->mode == &IND)
+        snprintf(out, size, "%s ($%04X) {IND}", inst->name, word);
+
+    const bool word_operand = inst->mode == &ABS || inst->mode == &ABX || inst->mode == &ABY || inst->mode == &IND;
+    return word_operand ? 3 : 2;
+}
+
+// Links the line for addr after the previous one
+void disasm_line(disasm *mapLines, uint16_t *lastline, const uint16_t line_addr, const char *text) {
+    mapLines[line_addr].inst = (char *)malloc(strlen(text) + 1);
+    strcpy(mapLines[line_addr].inst, text);
+    if (*lastline > 0) {
+        mapLines[*lastline].next = &mapLines[line_addr];
+        mapLines[line_addr].prev = &mapLines[*lastline];
+    }
+    *lastline = line_addr;
+}
+
+// A PRG-ROM byte the code/data log saw read, or stepped over as an operand, but never run
+bool logged_not_code(const Cartridge *cart, const uint16_t addr) {
+    const uint8_t flags = cdl->prg[cart->prg_banks[(addr >> 13) & 0x03] - cart->pgr + (addr & 0x1FFF)];
+    return (flags & (CDL_OPERAND | CDL_DATA)) != 0 && !(flags & CDL_CODE);
+}
+
 disasm *disassemble(Bus *bus, uint16_t nStart, uint16_t nStop) {
     uint32_t addr = nStart;
     uint8_t value = 0x00, lo = 0x00, hi = 0x00;
@@ -944,6 +1461,15 @@ disasm *disassemble(Bus *bus, uint16_t nStart, uint16_t nStop) {
         sprintf(buff, "$%04X: ", addr);
         strcat(sInst, buff);
 
+        // Shown a byte at a time, a linear disassembly starting in data or mid-instruction gets back in step
+        if (cdl != nullptr && addr >= 0x8000 && logged_not_code(bus->cart, addr)) {
+            sprintf(buff, ".DB $%02X {DATA}", bus->read(addr));
+            strcat(sInst, buff);
+            addr++;
+            disasm_line(mapLines, &lastline, line_addr, sInst);
+            continue;
+        }
+
         uint8_t opcode = bus->read(addr);
         addr++;
         strcat(sInst, lut[opcode].name);
@@ -1021,13 +1547,7 @@ disasm *disassemble(Bus *bus, uint16_t nStart, uint16_t nStop) {
             strcat(sInst, buff);
         }
 
-        mapLines[line_addr].inst = (char *)malloc(strlen(sInst) + 1);
-        strcpy(mapLines[line_addr].inst, sInst);
-        if (lastline > 0) {
-            mapLines[lastline].next = &mapLines[line_addr];
-            mapLines[line_addr].prev = &mapLines[lastline];
-        }
-        lastline = line_addr;
+        disasm_line(mapLines, &lastline, line_addr, sInst);
     }
 
     return mapLines;
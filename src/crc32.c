@@ -0,0 +1,133 @@
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC32_CLMUL
+#endif
+
+#define CRC32_POLY 0xEDB88320u
+
+uint32_t crc32_table[8][256];
+bool crc32_table_ready = false;
+
+void crc32_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRC32_POLY : c >> 1;
+        crc32_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc32_table[t][i] = (crc32_table[t - 1][i] >> 8) ^ crc32_table[0][crc32_table[t - 1][i] & 0xFF];
+    crc32_table_ready = true;
+}
+
+// Slicing-by-8, works on the raw (inverted) register
+uint32_t crc32_update_scalar(uint32_t c, const uint8_t *data, size_t len) {
+    if (!crc32_table_ready)
+        crc32_init_table();
+    while (len >= 8) {
+        const uint32_t lo = c ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        c = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^ crc32_table[5][(lo >> 16) & 0xFF] ^
+            crc32_table[4][lo >> 24] ^ crc32_table[3][data[4]] ^ crc32_table[2][data[5]] ^ crc32_table[1][data[6]] ^
+            crc32_table[0][data[7]];
+        data += 8;
+        len -= 8;
+    }
+    while (len-- > 0)
+        c = (c >> 8) ^ crc32_table[0][(c ^ *data++) & 0xFF];
+    return c;
+}
+
+uint32_t crc32_scalar(const uint32_t crc, const uint8_t *data, const size_t len) {
+    return ~crc32_update_scalar(~crc, data, len);
+}
+
+#ifdef CRC32_CLMUL
+// Folding constants for the reflected polynomial: x^(4*128+32), x^(4*128-32), x^(128+32), x^(128-32) mod P, then
+// x^64 mod P and the Barrett pair P' and mu (Intel, "Fast CRC Computation Using PCLMULQDQ")
+const uint64_t crc32_k1k2[2] = {0x0154442BD4, 0x01C6E41596};
+const uint64_t crc32_k3k4[2] = {0x01751997D0, 0x00CCAA009E};
+const uint64_t crc32_k5k0[2] = {0x0163CD6124, 0x0000000000};
+const uint64_t crc32_poly[2] = {0x01DB710641, 0x01F7011641};
+
+// Raw register update for len >= 64 and a multiple of 16
+__attribute__((target("pclmul,sse4.1"))) uint32_t crc32_update_clmul(const uint32_t c, const uint8_t *buf, size_t len) {
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    __m128i x0 = _mm_loadu_si128((const __m128i *)crc32_k1k2);
+    buf += 64;
+    len -= 64;
+
+    // Fold 64 bytes at a time into four accumulators
+    while (len >= 64) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(buf + 0x30)));
+        buf += 64;
+        len -= 64;
+    }
+
+    // Fold the accumulators into one, then the remaining 16 byte blocks
+    x0 = _mm_loadu_si128((const __m128i *)crc32_k3k4);
+    __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+    while (len >= 16) {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    // 128 -> 64 bits, then Barrett reduction to 32
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64((const __m128i *)crc32_k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadu_si128((const __m128i *)crc32_poly);
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
+uint32_t crc32(const uint32_t crc, const uint8_t *data, const size_t len) {
+    uint32_t c = ~crc;
+    size_t done = 0;
+#ifdef CRC32_CLMUL
+    if (len >= 64 && __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+        done = len & ~(size_t)15;
+        c = crc32_update_clmul(c, data, done);
+    }
+#endif
+    return ~crc32_update_scalar(c, data + done, len - done);
+}
@@ -0,0 +1,12 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, the one zip and the rom databases use). crc is the value returned for the previous chunk, 0 to
+// start. Uses carry-less multiply folding on x86 CPUs that have it, a table otherwise.
+uint32_t crc32(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t crc32_scalar(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif // CRC32_H
@@ -15,5 +15,7 @@ typedef struct LengthCounter Length;
 typedef struct Envelope Env;
 typedef struct Oscpulse Osc;
 typedef struct Sweeper Sweep;
+typedef struct Scheduler Scheduler;
+typedef struct BatterySave BatterySave;
 
 #endif // FORWARD_H
@@ -0,0 +1,58 @@
+#include <stdlib.h>
+
+#include "frameskip.h"
+#include "raylib.h"
+
+// Never drop more than this many frames in a row in auto mode, so the screen keeps moving on very slow machines
+constexpr uint32_t AUTO_MAX_SKIP = 4;
+
+FrameSkip *frameskip_new(const FrameSkipMode mode, const uint32_t interval, const double fps) {
+    FrameSkip *fs = calloc(1, sizeof(FrameSkip));
+    fs->mode = mode;
+    fs->interval = interval > 0 ? interval : 1;
+    fs->counter = 0;
+    fs->skipped_in_row = 0;
+    fs->period = 1.0 / fps;
+    fs->deadline = GetTime() + fs->period;
+    fs->missed_deadline = false;
+    return fs;
+}
+
+void frameskip_free(FrameSkip *fs) { free(fs); }
+
+bool frameskip_should_render(FrameSkip *fs) {
+    bool render = true;
+    switch (fs->mode) {
+        case FRAMESKIP_FIXED:
+            render = fs->counter == 0;
+            fs->counter = (fs->counter + 1) % fs->interval;
+            break;
+        case FRAMESKIP_AUTO:
+            render = !fs->missed_deadline || fs->skipped_in_row >= AUTO_MAX_SKIP;
+            break;
+        default:
+            break;
+    }
+
+    fs->skipped_in_row = render ? 0 : fs->skipped_in_row + 1;
+    return render;
+}
+
+// Paces the emulation to the target frame rate. Skipped frames never call EndDrawing, so raylib's own frame limiter
+// can't be used when frame skipping is on.
+void frameskip_end_frame(FrameSkip *fs) {
+    if (fs->mode == FRAMESKIP_OFF)
+        return;
+
+    const double now = GetTime();
+    fs->missed_deadline = now > fs->deadline;
+    if (!fs->missed_deadline) {
+        WaitTime(fs->deadline - now);
+        fs->deadline += fs->period;
+    } else if (now - fs->deadline > fs->period * AUTO_MAX_SKIP) {
+        // Too far behind to ever catch up, start over from now
+        fs->deadline = now + fs->period;
+    } else {
+        fs->deadline += fs->period;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef FRAMESKIP_H
+#define FRAMESKIP_H
+
+#include <stdint.h>
+
+typedef enum FrameSkipMode {
+    FRAMESKIP_OFF,
+    FRAMESKIP_FIXED, // Display one frame out of every `interval`
+    FRAMESKIP_AUTO,  // Skip a frame only when the previous one missed its deadline
+} FrameSkipMode;
+
+typedef struct FrameSkip {
+    FrameSkipMode mode;
+    uint32_t interval;
+    uint32_t counter;
+    uint32_t skipped_in_row;
+    double period;
+    double deadline;
+    bool missed_deadline;
+} FrameSkip;
+
+FrameSkip *frameskip_new(FrameSkipMode mode, uint32_t interval, double fps);
+void frameskip_free(FrameSkip *fs);
+
+bool frameskip_should_render(FrameSkip *fs);
+void frameskip_end_frame(FrameSkip *fs);
+
+#endif // FRAMESKIP_H
@@ -0,0 +1,305 @@
+#include <string.h>
+
+#include "inflate.h"
+
+#define MAX_BITS 15
+#define MAX_LITLEN_CODES 288
+#define MAX_DIST_CODES 30
+#define FAST_BITS 10
+
+// Canonical Huffman code. Codes up to FAST_BITS long are decoded with one lookup in `fast` (indexed by the next bits
+// of input, which arrive LSB first), longer ones by walking `count`/`symbol` one bit at a time.
+typedef struct Huffman {
+    uint16_t count[MAX_BITS + 1];
+    uint16_t symbol[MAX_LITLEN_CODES];
+    uint16_t fast[1 << FAST_BITS]; // length << 9 | symbol, 0 if the code is longer than FAST_BITS
+} Huffman;
+
+typedef struct Inflate {
+    const uint8_t *in;
+    size_t in_size;
+    size_t in_pos;
+    uint8_t *out;
+    size_t out_size;
+    size_t out_pos;
+    uint64_t bits;
+    uint32_t bit_count;
+    bool overrun; // Read past the end of the input
+} Inflate;
+
+const uint16_t length_base[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                  31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t dist_base[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Keeps at least 57 bits buffered while there is input left
+void inflate_refill(Inflate *s) {
+    while (s->bit_count <= 56) {
+        if (s->in_pos >= s->in_size)
+            return;
+        s->bits |= (uint64_t)s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+}
+
+uint32_t inflate_bits(Inflate *s, const uint32_t n) {
+    if (s->bit_count < n) {
+        inflate_refill(s);
+        if (s->bit_count < n) {
+            s->overrun = true;
+            return 0;
+        }
+    }
+    const uint32_t value = (uint32_t)(s->bits & ((1ull << n) - 1));
+    s->bits >>= n;
+    s->bit_count -= n;
+    return value;
+}
+
+// Returns false if the lengths don't make a usable code (over-subscribed); incomplete codes are allowed, a symbol
+// that isn't in them fails when decoded
+bool build_huffman(Huffman *h, const uint8_t *lengths, const uint16_t n) {
+    memset(h->count, 0, sizeof(h->count));
+    for (uint16_t i = 0; i < n; i++)
+        h->count[lengths[i]]++;
+    h->count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= MAX_BITS; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+            return false;
+    }
+
+    uint16_t offsets[MAX_BITS + 1];
+    offsets[1] = 0;
+    for (int len = 1; len < MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + h->count[len];
+    for (uint16_t i = 0; i < n; i++)
+        if (lengths[i] != 0)
+            h->symbol[offsets[lengths[i]]++] = i;
+
+    // Canonical codes in order, bit reversed to index the fast table
+    memset(h->fast, 0, sizeof(h->fast));
+    uint32_t code = 0;
+    uint16_t index = 0;
+    for (int len = 1; len <= FAST_BITS; len++) {
+        for (uint16_t i = 0; i < h->count[len]; i++, index++, code++) {
+            uint32_t reversed = 0;
+            for (int b = 0; b < len; b++)
+                reversed |= ((code >> b) & 1) << (len - 1 - b);
+            for (uint32_t fill = reversed; fill < (1u << FAST_BITS); fill += 1u << len)
+                h->fast[fill] = (uint16_t)(len << 9 | h->symbol[index]);
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+// Next symbol, -1 on a bad code or when the input ran out
+int inflate_decode(Inflate *s, const Huffman *h) {
+    if (s->bit_count < MAX_BITS)
+        inflate_refill(s);
+
+    const uint16_t entry = h->fast[s->bits & ((1u << FAST_BITS) - 1)];
+    if (entry != 0) {
+        const uint32_t len = entry >> 9;
+        if (len > s->bit_count) {
+            s->overrun = true;
+            return -1;
+        }
+        s->bits >>= len;
+        s->bit_count -= len;
+        return entry & 0x1FF;
+    }
+
+    int code = 0, first = 0, index = 0;
+    for (uint32_t len = 1; len <= MAX_BITS; len++) {
+        if (len > s->bit_count) {
+            s->overrun = true;
+            return -1;
+        }
+        code |= (int)((s->bits >> (len - 1)) & 1);
+        const int count = h->count[len];
+        if (code - count < first) {
+            s->bits >>= len;
+            s->bit_count -= len;
+            return h->symbol[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool inflate_stored(Inflate *s) {
+    // Drop to the byte boundary, then LEN and NLEN
+    inflate_bits(s, s->bit_count & 7);
+    const uint32_t len = inflate_bits(s, 16);
+    const uint32_t nlen = inflate_bits(s, 16);
+    if (s->overrun || len != (~nlen & 0xFFFF))
+        return false;
+
+    // Whole bytes still in the bit buffer come first
+    uint32_t copied = 0;
+    while (copied < len && s->bit_count >= 8) {
+        if (s->out_pos >= s->out_size)
+            return false;
+        s->out[s->out_pos++] = (uint8_t)inflate_bits(s, 8);
+        copied++;
+    }
+    const size_t rest = len - copied;
+    if (s->in_size - s->in_pos < rest || s->out_size - s->out_pos < rest)
+        return false;
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, rest);
+    s->in_pos += rest;
+    s->out_pos += rest;
+    return true;
+}
+
+bool inflate_codes(Inflate *s, const Huffman *litlen, const Huffman *dist) {
+    for (;;) {
+        const int symbol = inflate_decode(s, litlen);
+        if (symbol < 0)
+            return false;
+        if (symbol < 256) {
+            if (s->out_pos >= s->out_size)
+                return false;
+            s->out[s->out_pos++] = (uint8_t)symbol;
+            continue;
+        }
+        if (symbol == 256)
+            return true;
+
+        const int length_code = symbol - 257;
+        if (length_code >= 29)
+            return false;
+        const size_t length = length_base[length_code] + inflate_bits(s, length_extra[length_code]);
+        const int dist_code = inflate_decode(s, dist);
+        if (dist_code < 0 || dist_code >= MAX_DIST_CODES)
+            return false;
+        const size_t distance = dist_base[dist_code] + inflate_bits(s, dist_extra[dist_code]);
+        if (s->overrun || distance > s->out_pos || length > s->out_size - s->out_pos)
+            return false;
+
+        // Byte by byte when the source overlaps what is being written, that's how runs are encoded
+        uint8_t *dst = s->out + s->out_pos;
+        const uint8_t *src = dst - distance;
+        if (distance >= length) {
+            memcpy(dst, src, length);
+        } else {
+            for (size_t i = 0; i < length; i++)
+                dst[i] = src[i];
+        }
+        s->out_pos += length;
+    }
+}
+
+bool inflate_fixed(Inflate *s) {
+    static Huffman litlen, dist;
+    static bool built = false;
+    if (!built) {
+        uint8_t lengths[MAX_LITLEN_CODES];
+        for (int i = 0; i < 144; i++)
+            lengths[i] = 8;
+        for (int i = 144; i < 256; i++)
+            lengths[i] = 9;
+        for (int i = 256; i < 280; i++)
+            lengths[i] = 7;
+        for (int i = 280; i < MAX_LITLEN_CODES; i++)
+            lengths[i] = 8;
+        build_huffman(&litlen, lengths, MAX_LITLEN_CODES);
+        for (int i = 0; i < MAX_DIST_CODES; i++)
+            lengths[i] = 5;
+        build_huffman(&dist, lengths, MAX_DIST_CODES);
+        built = true;
+    }
+    return inflate_codes(s, &litlen, &dist);
+}
+
+bool inflate_dynamic(Inflate *s) {
+    static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    const uint32_t nlen = inflate_bits(s, 5) + 257;
+    const uint32_t ndist = inflate_bits(s, 5) + 1;
+    const uint32_t ncode = inflate_bits(s, 4) + 4;
+    if (s->overrun || nlen > 286 || ndist > MAX_DIST_CODES)
+        return false;
+
+    uint8_t lengths[MAX_LITLEN_CODES + MAX_DIST_CODES] = {0};
+    for (uint32_t i = 0; i < ncode; i++)
+        lengths[order[i]] = (uint8_t)inflate_bits(s, 3);
+    Huffman lencode;
+    if (s->overrun || !build_huffman(&lencode, lengths, 19))
+        return false;
+
+    // Literal/length and distance code lengths, run-length coded
+    uint32_t index = 0;
+    while (index < nlen + ndist) {
+        const int symbol = inflate_decode(s, &lencode);
+        if (symbol < 0)
+            return false;
+        if (symbol < 16) {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+        uint8_t len = 0;
+        uint32_t repeat;
+        if (symbol == 16) {
+            if (index == 0)
+                return false;
+            len = lengths[index - 1];
+            repeat = 3 + inflate_bits(s, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + inflate_bits(s, 3);
+        } else {
+            repeat = 11 + inflate_bits(s, 7);
+        }
+        if (s->overrun || index + repeat > nlen + ndist)
+            return false;
+        while (repeat-- > 0)
+            lengths[index++] = len;
+    }
+    if (lengths[256] == 0)
+        return false;
+
+    Huffman litlen, dist;
+    if (!build_huffman(&litlen, lengths, (uint16_t)nlen) || !build_huffman(&dist, lengths + nlen, (uint16_t)ndist))
+        return false;
+    return inflate_codes(s, &litlen, &dist);
+}
+
+// Decodes a complete DEFLATE stream into out. Fails on corrupt data or if the output doesn't fit.
+bool inflate_raw(const uint8_t *in, const size_t in_size, uint8_t *out, const size_t out_size, size_t *out_written) {
+    Inflate s = {.in = in, .in_size = in_size, .out = out, .out_size = out_size};
+    bool last;
+    do {
+        last = inflate_bits(&s, 1);
+        const uint32_t type = inflate_bits(&s, 2);
+        if (s.overrun)
+            return false;
+
+        bool ok;
+        switch (type) {
+            case 0:
+                ok = inflate_stored(&s);
+                break;
+            case 1:
+                ok = inflate_fixed(&s);
+                break;
+            case 2:
+                ok = inflate_dynamic(&s);
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok || s.overrun)
+            return false;
+    } while (!last);
+
+    *out_written = s.out_pos;
+    return true;
+}
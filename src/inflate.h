@@ -0,0 +1,11 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw DEFLATE (RFC 1951) decoder for loading compressed roms. The whole output buffer is known up front, so there is
+// no sliding window: back references read straight from what was already written.
+bool inflate_raw(const uint8_t *in, size_t in_size, uint8_t *out, size_t out_size, size_t *out_written);
+
+#endif // INFLATE_H
@@ -3,22 +3,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "bus.h"
 #include "cartridge.h"
+#include "cdl.h"
 #include "cpu.h"
+#include "frameskip.h"
 #include "ppu.h"
+#include "ppu_deferred.h"
 #include "raylib.h"
 #include "ringbuffer.h"
+#include "timing.h"
+#include "trace.h"
 
 Font font;
 
 void print_usage(const char *executable);
 void draw_ram(const Bus *bus, int x, int y, uint16_t addr, int rows, int cols);
-void draw_code(const Bus *bus, int x, int y, int lines);
-void draw_cpu(const Bus *bus, int x, int y);
+void draw_code(uint16_t pc, int x, int y, int lines);
+void draw_cpu(const IdleStep *regs, int x, int y);
 void draw_string(const char *text, int x, int y, int size, Color c);
 void draw_sprite_info(const Bus *bus, int x, int y);
+#ifdef ZNES_TIMING
+void draw_timing(int x, int y);
+#endif
 
 constexpr int FONTSIZE = 14;
 const char *FONT_NAME = "/usr/share/fonts/Adwaita/AdwaitaMono-Bold.ttf";
@@ -26,6 +37,12 @@ constexpr Color BG_BLUE = {0x00, 0x00, 0x66, 0xFF};
 
 disasm *array_asm;
 Bus *main_bus;
+bool no_idle_skip = false; // Clock the CPU through idle loops, to check skipping them changes nothing
+const char *timing_path;   // Per-frame phase times are written here on exit, see timing.h
+bool timing_overlay = false;
+const char *trace_path; // Instruction trace dumps, see trace.h
+int32_t trace_pc = -1;  // Dump the trace the first time the CPU gets here
+const char *cdl_path;   // Code/data log, loaded and added to when it exists, see cdl.h
 
 bool handle_ui_input(int *scale, int *window_width, int *window_height, Cartridge **cart, int *debugger_x, int *pattern_y, int *nametable_y,
                      bool resize, bool *emulate) {
@@ -61,8 +78,17 @@ bool handle_ui_input(int *scale, int *window_width, int *window_height, Cartridg
     if (IsKeyPressed(KEY_P))
         *emulate = !*emulate;
 
+#ifdef ZNES_TIMING
+    if (IsKeyPressed(KEY_T))
+        timing_overlay = !timing_overlay;
+#endif
+
+    if (IsKeyPressed(KEY_D))
+        trace_dump("on demand");
+
     if (IsKeyPressed(KEY_R)) {
         bus_reset();
+        ppu_deferred_resync();
 
         // Clean pressed keys
         BeginDrawing();
@@ -87,6 +113,8 @@ void update_controller_input(Bus *bus) {
 
 RingBuffer *audio_buffer;
 
+void push_audio_sample(const double sample) { ring_buffer_put(audio_buffer, (short)sample); }
+
 void AudioInputCallback(void *buffer, unsigned int frames) {
     short *d = buffer;
     short data = 0;
@@ -96,13 +124,272 @@ void AudioInputCallback(void *buffer, unsigned int frames) {
     }
 }
 
+bool parse_frameskip(const char *arg, FrameSkipMode *mode, uint32_t *interval) {
+    if (strcmp(arg, "auto") == 0) {
+        *mode = FRAMESKIP_AUTO;
+        return true;
+    }
+
+    char *end;
+    const long n = strtol(arg, &end, 10);
+    if (*end != '\0' || n < 1)
+        return false;
+
+    *mode = n > 1 ? FRAMESKIP_FIXED : FRAMESKIP_OFF;
+    *interval = (uint32_t)n;
+    return true;
+}
+
+// "C000", "$C000" or "0xC000"
+bool parse_address(const char *arg, int32_t *address) {
+    char *end;
+    const long n = strtol(arg[0] == '$' ? arg + 1 : arg, &end, 16);
+    if (*end != '\0' || end == arg || n < 0 || n > 0xFFFF)
+        return false;
+    *address = (int32_t)n;
+    return true;
+}
+
+bool parse_count(const char *arg, uint32_t *count) {
+    char *end;
+    const long n = strtol(arg, &end, 10);
+    if (*end != '\0' || n < 1)
+        return false;
+    *count = (uint32_t)n;
+    return true;
+}
+
+FILE *dump_file;
+
+// Appends a frame as raw RGB24, e.g. for ffmpeg -f rawvideo -pix_fmt rgb24 -s 256x240 -r 60 -i dump.rgb
+void dump_frame(uint8_t frame[256][240]) {
+    static uint8_t rgb[240][256][3];
+    for (int y = 0; y < 240; y++) {
+        for (int x = 0; x < 256; x++) {
+            const Color *c = get_color_by_index(frame[x][y]);
+            rgb[y][x][0] = c->r;
+            rgb[y][x][1] = c->g;
+            rgb[y][x][2] = c->b;
+        }
+    }
+    fwrite(rgb, 1, sizeof(rgb), dump_file);
+}
+
+typedef struct HeadlessStats {
+    double startup_ms; // Loading the rom and bringing up the emulator
+    double fps;
+    double render_ms; // Per frame on the render thread(s), deferred PPU only
+} HeadlessStats;
+
+double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Emulates the given number of frames as fast as possible without window or audio. Returns false if the rom can't be
+// loaded.
+bool run_headless(const char *rom_file, const uint32_t frames, const bool deferred_ppu, const int render_threads,
+                  HeadlessStats *stats) {
+    struct timespec start, ready, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Cartridge *cart = cartridge_new(rom_file);
+    if (cart == nullptr)
+        return false;
+
+    main_bus = bus_new();
+    if (no_idle_skip)
+        main_bus->cpu->idle_skip = false;
+    set_cart(cart);
+    if (cdl_path != nullptr && !cdl_start(cdl_path, cart)) {
+        bus_free();
+        cartridge_free(cart);
+        return false;
+    }
+    bus_reset();
+    if (trace_path != nullptr)
+        trace_start(trace_path, trace_pc, &main_bus->ppu->scanline, &main_bus->ppu->cycle);
+    if (deferred_ppu) {
+        ppu_deferred_start(main_bus->ppu, render_threads);
+        if (dump_file != nullptr)
+            ppu_deferred_set_frame_callback(&dump_frame);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ready);
+
+    for (uint32_t f = 0; f < frames; f++) {
+        TIMING_BEGIN();
+        bus_run_frame();
+        TIMING_END(LOOP_EMULATION);
+        TIMING_END_FRAME();
+        main_bus->ppu->frame_complete = false;
+        if (!deferred_ppu && dump_file != nullptr)
+            dump_frame(main_bus->ppu->screen_buffer);
+    }
+    stats->render_ms = 0.0;
+    if (deferred_ppu) {
+        stats->render_ms = ppu_deferred_render_ms();
+        ppu_deferred_stop(); // Waits for the frames still queued
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    trace_dump("exit");
+    trace_stop();
+    cdl_save();
+    cdl_stop();
+    bus_free();
+    cartridge_free(cart);
+    stats->startup_ms = seconds_between(&start, &ready) * 1000.0;
+    stats->fps = frames / seconds_between(&ready, &end);
+    return true;
+}
+
+// Runs the same headless workload with 1, 2, 4... render threads up to the number of cores
+int report_scaling(const char *rom_file, const uint32_t frames) {
+    const int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    HeadlessStats stats;
+    if (!run_headless(rom_file, frames, false, 0, &stats))
+        return 1;
+
+    // "vs inline" is what deferring buys the emulation thread, "speedup" what the bands buy the render side
+    printf("%u frames, %d cores\n", frames, cores);
+    printf("%-16s %10s %10s %18s %10s\n", "render threads", "fps", "vs inline", "render ms/frame", "speedup");
+    printf("%-16s %10.1f %10s %18s %10s\n", "none", stats.fps, "-", "-", "-");
+    const double inline_fps = stats.fps;
+    double serial_ms = 0.0;
+    for (int threads = 1; threads <= cores; threads = threads * 2 > cores && threads < cores ? cores : threads * 2) {
+        run_headless(rom_file, frames, true, threads, &stats);
+        if (threads == 1)
+            serial_ms = stats.render_ms;
+        printf("%-16d %10.1f %9.2fx %18.3f %9.2fx\n", threads, stats.fps, stats.fps / inline_fps, stats.render_ms,
+               stats.render_ms > 0 ? serial_ms / stats.render_ms : 0.0);
+    }
+    if (cores == 1)
+        printf("One core: the render thread takes turns with the emulation thread, deferring can only cost time\n");
+    return 0;
+}
+
 int main(int argc, char **argv) {
-    if (argc != 2) {
+    char *rom_file = nullptr;
+    FrameSkipMode frameskip_mode = FRAMESKIP_OFF;
+    uint32_t frameskip_interval = 1;
+    bool deferred_ppu = false;
+    uint32_t render_threads = 1;
+    uint32_t headless_frames = 0;
+    uint32_t scaling_frames = 0;
+    const char *dump_path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--deferred-ppu") == 0) {
+            deferred_ppu = true;
+        } else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc) {
+            if (!parse_count(argv[++i], &render_threads)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            deferred_ppu = true;
+        } else if (strcmp(argv[i], "--no-idle-skip") == 0) {
+            no_idle_skip = true;
+        } else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            if (!parse_count(argv[++i], &headless_frames)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) {
+            if (!parse_count(argv[++i], &scaling_frames)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            timing_path = argv[++i];
+#ifndef ZNES_TIMING
+            fprintf(stderr, "--timing needs a build with -DZNES_TIMING=ON.\n");
+            return 1;
+#endif
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace-pc") == 0 && i + 1 < argc) {
+            if (!parse_address(argv[++i], &trace_pc)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cdl") == 0 && i + 1 < argc) {
+            cdl_path = argv[++i];
+        } else if (strcmp(argv[i], "--perf") == 0) {
+#ifdef ZNES_TIMING
+            timing_open_counters();
+#else
+            fprintf(stderr, "--perf needs a build with -DZNES_TIMING=ON.\n");
+            return 1;
+#endif
+        } else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc) {
+            if (!parse_frameskip(argv[++i], &frameskip_mode, &frameskip_interval)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (rom_file == nullptr && argv[i][0] != '-') {
+            rom_file = argv[i];
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (rom_file == nullptr) {
         print_usage(argv[0]);
         return 1;
     }
 
-    char *rom_file = argv[1];
+    // The log is filled by the PPU on the emulation thread, not by render threads replaying it
+    if (cdl_path != nullptr && (deferred_ppu || scaling_frames > 0)) {
+        fprintf(stderr, "--cdl can't be used with a deferred PPU.\n");
+        return 1;
+    }
+    // Skipped frames don't fetch the background and sprite patterns, their CHR use would go unlogged
+    if (cdl_path != nullptr && frameskip_mode != FRAMESKIP_OFF) {
+        fprintf(stderr, "--cdl can't be used with --frameskip.\n");
+        return 1;
+    }
+
+    if (scaling_frames > 0)
+        return report_scaling(rom_file, scaling_frames);
+
+    // Without a spare core the render thread only competes with the emulation thread and adds a lock per frame
+    // (stress0 runs at 163 fps deferred against 222 inline on one core)
+    if (deferred_ppu && sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+        fprintf(stderr, "Only one core online, rendering on the emulation thread instead of deferring.\n");
+        deferred_ppu = false;
+    }
+
+    if (headless_frames > 0) {
+        if (dump_path != nullptr) {
+            dump_file = fopen(dump_path, "wb");
+            if (dump_file == nullptr) {
+                fprintf(stderr, "Error opening %s.\n", dump_path);
+                return 1;
+            }
+        }
+        HeadlessStats stats;
+        const bool ok = run_headless(rom_file, headless_frames, deferred_ppu, (int)render_threads, &stats);
+        if (dump_file != nullptr)
+            fclose(dump_file);
+        if (!ok)
+            return 1;
+#ifdef ZNES_TIMING
+        if (timing_path != nullptr && !timing_export(timing_path))
+            return 1;
+#endif
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        printf("%u frames, %.1f fps", headless_frames, stats.fps);
+        if (deferred_ppu)
+            printf(", %.3f ms/frame on %u render thread(s)", stats.render_ms, render_threads);
+        printf("\nstartup %.3f ms, max RSS %ld KB\n", stats.startup_ms, usage.ru_maxrss);
+#ifdef ZNES_TIMING
+        timing_print_counters(stdout);
+#endif
+        return 0;
+    }
 
     Cartridge *cart = cartridge_new(rom_file);
     if (cart == nullptr) {
@@ -125,9 +412,19 @@ int main(int argc, char **argv) {
     SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
 
     main_bus = bus_new();
+    if (no_idle_skip)
+        main_bus->cpu->idle_skip = false;
     set_cart(cart);
+    if (cdl_path != nullptr && !cdl_start(cdl_path, cart)) {
+        CloseWindow();
+        return 1;
+    }
     array_asm = disassemble(main_bus, 0x0000, 0xFFFF);
     bus_reset();
+    if (trace_path != nullptr)
+        trace_start(trace_path, trace_pc, &main_bus->ppu->scanline, &main_bus->ppu->cycle);
+    if (deferred_ppu)
+        ppu_deferred_start(main_bus->ppu, (int)render_threads);
 
     int debugger_x = 256 * scale + 4;
     int pattern_y;
@@ -136,38 +433,54 @@ int main(int argc, char **argv) {
     bool resize = true;
     bool emulate = true;
 
-    SetTargetFPS(60);
+    // With frame skip on, pacing is done by frameskip_end_frame() since skipped frames never reach EndDrawing()
+    SetTargetFPS(frameskip_mode == FRAMESKIP_OFF ? 60 : 0);
+    FrameSkip *frameskip = frameskip_new(frameskip_mode, frameskip_interval, 60.0);
     SetSampleFrequency(44100);
 
     audio_buffer = ring_buffer_init(24 * 1024 * sizeof(short));
+    main_bus->audio_out = &push_audio_sample;
     InitAudioDevice();
     AudioStream stream = LoadAudioStream(44100, 16, 1);
     SetAudioStreamCallback(stream, AudioInputCallback);
     PlayAudioStream(stream);
     while (!WindowShouldClose()) {
-        while (!main_bus->ppu->frame_complete) {
-            while (!bus_clock()) {
-            }
-            ring_buffer_put(audio_buffer, (short)main_bus->dAudioSample);
-        }
+        const bool render = frameskip_should_render(frameskip);
+        if (deferred_ppu)
+            ppu_deferred_set_render(render);
+        else
+            main_bus->ppu->skip_render = !render;
+        TIMING_BEGIN();
+        bus_run_frame();
+        TIMING_END(LOOP_EMULATION);
 
         if (handle_ui_input(&scale, &window_width, &window_height, &cart, &debugger_x, &pattern_y, &nametable_y, resize, &emulate))
             continue;
 
         update_controller_input(main_bus);
 
-        if (main_bus->ppu->frame_complete) {
+        if (main_bus->ppu->frame_complete && !render) {
+            main_bus->ppu->frame_complete = false;
+            PollInputEvents();
+        } else if (main_bus->ppu->frame_complete) {
             main_bus->ppu->frame_complete = false;
+            TIMING_BEGIN();
             raylib_render_pattern_table(0, 0);
             raylib_render_pattern_table(1, 0);
+            if (deferred_ppu)
+                ppu_deferred_present();
             gen_screen_texture();
+            TIMING_END(LOOP_TEXTURES);
 
+            TIMING_BEGIN();
             BeginDrawing();
             ClearBackground(BG_BLUE);
 
-            draw_cpu(main_bus, debugger_x, 2);
+            // Where an idle CPU would be had it kept running, without waking it
+            const IdleStep regs = cpu_registers();
+            draw_cpu(&regs, debugger_x, 2);
             if (scale > 1) {
-                draw_code(main_bus, debugger_x, 72, 24);
+                draw_code(regs.pc, debugger_x, 72, 24);
                 //  draw_sprite_info(bus, debugger_x, 72);
             }
 
@@ -179,16 +492,39 @@ int main(int argc, char **argv) {
 
             DrawTexture(main_bus->ppu->texture_pattern[0].texture, debugger_x, nametable_y, WHITE);
             DrawTexture(main_bus->ppu->texture_pattern[1].texture, debugger_x + 132, nametable_y, WHITE);
+            TIMING_END(LOOP_DEBUGGER);
 
+            TIMING_BEGIN();
             // DrawRam(bus, 0, 0, 0x0000, 16, 16);
             DrawTextureEx(main_bus->ppu->texture_screen.texture, (Vector2){0, 0}, 0, scale, WHITE);
             // DrawText(TextFormat("FPS: %d", GetFPS()), 10, 10, 20, DARKGRAY);
+#ifdef ZNES_TIMING
+            if (timing_overlay)
+                draw_timing(4, 4);
+#endif
 
             EndDrawing();
+            TIMING_END(LOOP_PRESENT);
         }
-    }
 
+        TIMING_BEGIN();
+        frameskip_end_frame(frameskip);
+        TIMING_END(LOOP_PRESENT);
+        TIMING_END_FRAME();
+    }
+#ifdef ZNES_TIMING
+    if (timing_path != nullptr)
+        timing_export(timing_path);
+#endif
+
+    frameskip_free(frameskip);
+    ppu_deferred_stop();
+    trace_dump("exit");
+    trace_stop();
+    cdl_save();
+    cdl_stop();
     bus_free();
+    cartridge_free(cart); // Writes the battery save
     StopAudioStream(stream);
     while (IsAudioStreamPlaying(stream)) {
     }
@@ -215,7 +551,31 @@ const char *get_filename(const char *path) {
     return filename;
 }
 
-void print_usage(const char *executable) { printf("Usage: %s rom\n", get_filename(executable)); }
+void print_usage(const char *executable) {
+    printf("Usage: %s [--frameskip N|auto] [--deferred-ppu] [--render-threads N] [--no-idle-skip] "
+           "[--headless FRAMES [--dump FILE]] [--scaling FRAMES] [--timing FILE] [--perf] "
+           "[--trace FILE [--trace-pc ADDR]] [--cdl FILE] rom\n",
+           get_filename(executable));
+    printf("  --frameskip N       display one frame out of every N\n");
+    printf("  --frameskip auto    skip a frame only when the previous one missed its deadline\n");
+    printf("  --deferred-ppu      render frames on a separate thread from a log of PPU register writes, needs a\n");
+    printf("                      second core and is ignored with only one online\n");
+    printf("  --render-threads N  split deferred frames in scanline bands rendered by N threads\n");
+    printf("  --no-idle-skip      keep clocking the CPU while it spins in a loop waiting for an interrupt\n");
+    printf("  --headless FRAMES   run FRAMES frames as fast as possible without window or audio\n");
+    printf("  --dump FILE         with --headless, write every frame to FILE as raw 256x240 RGB24\n");
+    printf("  --scaling FRAMES    report headless render throughput for 1 to all cores render threads\n");
+    printf("  --timing FILE       on exit, write the time each frame spent per phase to FILE, JSON if it ends in\n");
+    printf("                      .json and CSV otherwise; needs a -DZNES_TIMING=ON build, where T shows p50/p99/max\n");
+    printf("  --trace FILE        record every instruction in a ring of the last %d, dumped to FILE on exit, on D,\n",
+           TRACE_RECORDS);
+    printf("                      on a crash and on an unknown opcode; tools/trace_decode.c reads the dumps\n");
+    printf("  --trace-pc ADDR     with --trace, also dump when the CPU reaches ADDR (hex)\n");
+    printf("  --cdl FILE          log which PRG bytes run as code or are read as data and which CHR bytes are\n");
+    printf("                      rendered, added to FILE on exit; znes-recomp and the disassembly use it\n");
+    printf("  --perf              with -DZNES_TIMING=ON, also read the host's hardware counters around each loop\n");
+    printf("                      phase and report IPC and cache and branch misses per frame\n");
+}
 
 void draw_ram(const Bus *bus, const int x, const int y, uint16_t addr, int rows, int cols) {
     const int ram_x = x;
@@ -234,33 +594,65 @@ void draw_ram(const Bus *bus, const int x, const int y, uint16_t addr, int rows,
     }
 }
 
-void draw_cpu(const Bus *bus, const int x, const int y) {
+void draw_cpu(const IdleStep *regs, const int x, const int y) {
     draw_string("STATUS:", x, y, FONTSIZE, WHITE);
-    draw_string("N", x + 60 + 0 * 15, y, FONTSIZE, (bus->cpu->status & N) ? GREEN : RED);
-    draw_string("V", x + 60 + 1 * 15, y, FONTSIZE, (bus->cpu->status & V) ? GREEN : RED);
-    draw_string("-", x + 60 + 2 * 15, y, FONTSIZE, (bus->cpu->status & U) ? GREEN : RED);
-    draw_string("B", x + 60 + 3 * 15, y, FONTSIZE, (bus->cpu->status & B) ? GREEN : RED);
-    draw_string("D", x + 60 + 4 * 15, y, FONTSIZE, (bus->cpu->status & D) ? GREEN : RED);
-    draw_string("I", x + 60 + 5 * 15, y, FONTSIZE, (bus->cpu->status & I) ? GREEN : RED);
-    draw_string("Z", x + 60 + 6 * 15, y, FONTSIZE, (bus->cpu->status & Z) ? GREEN : RED);
-    draw_string("C", x + 60 + 7 * 15, y, FONTSIZE, (bus->cpu->status & C) ? GREEN : RED);
+    draw_string("N", x + 60 + 0 * 15, y, FONTSIZE, (regs->status & N) ? GREEN : RED);
+    draw_string("V", x + 60 + 1 * 15, y, FONTSIZE, (regs->status & V) ? GREEN : RED);
+    draw_string("-", x + 60 + 2 * 15, y, FONTSIZE, (regs->status & U) ? GREEN : RED);
+    draw_string("B", x + 60 + 3 * 15, y, FONTSIZE, (regs->status & B) ? GREEN : RED);
+    draw_string("D", x + 60 + 4 * 15, y, FONTSIZE, (regs->status & D) ? GREEN : RED);
+    draw_string("I", x + 60 + 5 * 15, y, FONTSIZE, (regs->status & I) ? GREEN : RED);
+    draw_string("Z", x + 60 + 6 * 15, y, FONTSIZE, (regs->status & Z) ? GREEN : RED);
+    draw_string("C", x + 60 + 7 * 15, y, FONTSIZE, (regs->status & C) ? GREEN : RED);
     char temp[1024];
-    sprintf(temp, "PC: $%04X    SP: $%04X", bus->cpu->pc, bus->cpu->sp);
+    sprintf(temp, "PC: $%04X    SP: $%04X", regs->pc, regs->sp);
     draw_string(temp, x, y + FONTSIZE, FONTSIZE, WHITE);
-    sprintf(temp, "X: $%02X [%d]   Y: $%02X [%d]", bus->cpu->x, bus->cpu->x, bus->cpu->y, bus->cpu->y);
+    sprintf(temp, "X: $%02X [%d]   Y: $%02X [%d]", regs->x, regs->x, regs->y, regs->y);
     draw_string(temp, x, y + FONTSIZE * 2, FONTSIZE, WHITE);
-    sprintf(temp, "A: $%02X [%d]", bus->cpu->a, bus->cpu->a);
+    sprintf(temp, "A: $%02X [%d]", regs->a, regs->a);
     draw_string(temp, x, y + FONTSIZE * 3, FONTSIZE, WHITE);
 }
 
+#ifdef ZNES_TIMING
+// Milliseconds per phase over the last TIMING_WINDOW frames, and with --perf the counters per frame; T toggles it
+void draw_timing(const int x, const int y) {
+    const int rows = PHASE_COUNT + 1 + (timing.counting ? LOOP_PHASE_COUNT + 1 : 0);
+    DrawRectangle(x, y, 300, FONTSIZE * rows + 4, Fade(BLACK, 0.7f));
+    draw_string("ms        p50    p99    max", x + 4, y + 2, FONTSIZE, YELLOW);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double p50, p99, max;
+        timing_summary(p, &p50, &p99, &max);
+        char temp[64];
+        sprintf(temp, "%-8s %6.2f %6.2f %6.2f", timing_phase_name(p), p50, p99, max);
+        draw_string(temp, x + 4, y + 2 + FONTSIZE * (p + 1), FONTSIZE, WHITE);
+    }
+    if (!timing.counting)
+        return;
+
+    // Misses in thousands per frame
+    int line_y = y + 2 + FONTSIZE * (PHASE_COUNT + 1);
+    draw_string("k/frame    IPC    L1d    LLC     br", x + 4, line_y, FONTSIZE, YELLOW);
+    for (int p = 0; p < LOOP_PHASE_COUNT; p++) {
+        double per_frame[PERF_COUNTER_COUNT];
+        timing_counters_summary(p, per_frame);
+        char temp[64];
+        sprintf(temp, "%-9s %5.2f %6.1f %6.1f %6.1f", timing_loop_phase_name(p),
+                per_frame[PERF_CYCLES] > 0 ? per_frame[PERF_INSTRUCTIONS] / per_frame[PERF_CYCLES] : 0.0,
+                per_frame[PERF_L1D_MISSES] / 1e3, per_frame[PERF_LLC_MISSES] / 1e3, per_frame[PERF_BRANCH_MISSES] / 1e3);
+        line_y += FONTSIZE;
+        draw_string(temp, x + 4, line_y, FONTSIZE, WHITE);
+    }
+}
+#endif
+
 void draw_string(const char *text, const int x, const int y, const int size, const Color c) {
     DrawTextEx(font, text, (Vector2){(float)x, (float)y}, (float)size, 1, c);
 }
 
-void draw_code(const Bus *bus, const int x, const int y, const int lines) {
+void draw_code(const uint16_t pc, const int x, const int y, const int lines) {
     if (array_asm == nullptr)
         return;
-    const disasm *inst = &array_asm[bus->cpu->pc];
+    const disasm *inst = &array_asm[pc];
     int line_y = (lines >> 1) * 10 + y;
     if (inst != nullptr && inst->inst != nullptr) {
         draw_string(inst->inst, x, line_y, FONTSIZE, SKYBLUE);
@@ -275,7 +667,7 @@ void draw_code(const Bus *bus, const int x, const int y, const int lines) {
         }
     }
 
-    inst = &array_asm[bus->cpu->pc];
+    inst = &array_asm[pc];
     line_y = (lines >> 1) * 10 + y;
     if (inst != nullptr) {
         while (line_y > y) {
@@ -5,12 +5,14 @@
 
 #include "forward.h"
 
+// Mappers don't translate addresses on every access: they point the cartridge's PRG and CHR bank slots (see
+// cart_map_prg_8k() and friends) at the right part of the rom and only run code when the CPU writes to one of their
+// registers.
 typedef struct Mapper {
     CartridgeInfo *info;
-    bool (*cpu_read)(uint16_t addr, uint32_t *mapped_addr, uint8_t *value);
-    bool (*cpu_write)(uint16_t addr, uint32_t *mapped_addr, uint8_t value);
-    bool (*ppu_read)(uint16_t addr, uint32_t *mapped_addr, uint8_t *value);
-    bool (*ppu_write)(uint16_t addr, uint32_t *mapped_addr, uint8_t value);
+    void (*write)(uint16_t addr, uint8_t value); // CPU write to $8000-$FFFF, nullptr when the board has no registers
+    void (*event)(uint64_t time);                // EVENT_MAPPER handler, nullptr if the mapper never schedules it
+    void (*reset)(void);                         // Console reset, nullptr if there's nothing to do
 } Mapper;
 
 void mapper_free(Mapper *map);
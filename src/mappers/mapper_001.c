@@ -0,0 +1,119 @@
+#include <stdlib.h>
+
+#include "cartridge.h"
+#include "mapper_001.h"
+
+#include "scheduler.h"
+
+// MMC1: registers are loaded one bit at a time through a 5-bit shift register, the fifth write to $8000-$FFFF copies
+// it into the register picked by address bits 13-14
+
+#define CONTROL_MIRRORING 0x03
+#define CONTROL_PRG_MODE 0x0C
+#define CONTROL_CHR_4K 0x10
+#define PRG_RAM_DISABLE 0x10
+#define SUROM_PRG_SIZE (512 * 1024)
+
+Mapper *map001;
+
+uint8_t map001_shift = 0x10; // Bit 4 set marks an empty register: it reaches bit 0 after four more writes
+uint8_t map001_control = 0x0C;
+uint8_t map001_chr_bank0 = 0x00;
+uint8_t map001_chr_bank1 = 0x00;
+uint8_t map001_prg_bank = 0x00;
+uint64_t map001_last_write = 0;
+
+constexpr MirroringType mirroring_001[4] = {ONESCREEN_LO, ONESCREEN_HI, VERTICAL, HORIZONTAL};
+
+// Recomputes the bank slots, only called when a register changes
+void update_banks_001(void) {
+    // SUROM uses CHR bank bit 4 to pick the 256KB half of its 512KB PRG-ROM
+    const int32_t outer = map001->info->prg_rom_size >= SUROM_PRG_SIZE ? map001_chr_bank0 & 0x10 : 0;
+    const int32_t bank = outer | (map001_prg_bank & 0x0F);
+    switch ((map001_control & CONTROL_PRG_MODE) >> 2) {
+        case 0:
+        case 1:
+            cart_map_prg_32k(bank >> 1);
+            break;
+        case 2: // First bank fixed at $8000
+            cart_map_prg_16k(0, outer);
+            cart_map_prg_16k(1, bank);
+            break;
+        case 3: // Last bank fixed at $C000
+            cart_map_prg_16k(0, bank);
+            cart_map_prg_16k(1, outer | 0x0F);
+            break;
+        default:
+            break;
+    }
+
+    if (map001_control & CONTROL_CHR_4K) {
+        cart_map_chr_4k(0, map001_chr_bank0);
+        cart_map_chr_4k(1, map001_chr_bank1);
+    } else {
+        cart_map_chr_8k(map001_chr_bank0 >> 1);
+    }
+}
+
+void write_001(const uint16_t addr, const uint8_t value) {
+    // The second write of a read-modify-write instruction lands on the very next CPU cycle and is ignored
+    const uint64_t now = scheduler_now();
+    const bool consecutive = now - map001_last_write <= 3;
+    map001_last_write = now;
+    if (consecutive)
+        return;
+
+    if (value & 0x80) {
+        map001_shift = 0x10;
+        map001_control |= 0x0C;
+        update_banks_001();
+        return;
+    }
+
+    const bool full = map001_shift & 0x01;
+    map001_shift = (map001_shift >> 1) | ((value & 0x01) << 4);
+    if (!full)
+        return;
+
+    const uint8_t data = map001_shift;
+    map001_shift = 0x10;
+    switch ((addr >> 13) & 0x03) {
+        case 0:
+            map001_control = data;
+            cart_set_mirror(mirroring_001[data & CONTROL_MIRRORING]);
+            break;
+        case 1:
+            map001_chr_bank0 = data;
+            // SOROM and SXROM select their 8KB PRG-RAM bank with the upper CHR bank bits
+            if (map001->info->prg_ram_size > PRG_RAM_SIZE)
+                cart_map_prg_ram(map001->info->prg_ram_size > 2 * PRG_RAM_SIZE ? (data >> 2) & 0x03 : (data >> 3) & 0x01);
+            break;
+        case 2:
+            map001_chr_bank1 = data;
+            break;
+        case 3:
+            map001_prg_bank = data;
+            cart_set_prg_ram_enabled(!(data & PRG_RAM_DISABLE));
+            break;
+        default:
+            break;
+    }
+    update_banks_001();
+}
+
+Mapper *new_mapper_001(CartridgeInfo *info) {
+    map001 = calloc(1, sizeof(Mapper));
+    map001->info = info;
+    map001->write = &write_001;
+
+    map001_shift = 0x10;
+    map001_control = 0x0C;
+    map001_chr_bank0 = 0x00;
+    map001_chr_bank1 = 0x00;
+    map001_prg_bank = 0x00;
+    map001_last_write = 0;
+
+    // Power on state: 16KB mode with the last bank fixed, mirroring from the header until the game sets it
+    update_banks_001();
+    return map001;
+}
@@ -0,0 +1,8 @@
+#ifndef MAPPER_001_H
+#define MAPPER_001_H
+
+#include "mapper.h"
+
+Mapper *new_mapper_001(CartridgeInfo *info);
+
+#endif // MAPPER_001_H
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+
+#include "cartridge.h"
+#include "mapper_004.h"
+
+#include "cpu.h"
+#include "ppu.h"
+#include "scheduler.h"
+
+// MMC3: eight bank registers behind a select/data pair, and a scanline counter clocked by rising edges of PPU A12.
+// The edge is at a fixed dot of every rendered line, so instead of watching PPU fetches the next one is scheduled as
+// an EVENT_MAPPER and the counter is clocked there.
+
+#define SELECT_REGISTER 0x07
+#define SELECT_PRG_MODE 0x40
+#define SELECT_CHR_INVERT 0x80
+#define DEFAULT_EDGE_DOT 260
+
+Mapper *map004;
+
+uint8_t map004_select = 0x00;
+uint8_t map004_registers[8] = {0};
+uint8_t map004_irq_latch = 0x00;
+uint8_t map004_irq_counter = 0x00;
+bool map004_irq_reload = false;
+bool map004_irq_enabled = false;
+
+void update_banks_004(void) {
+    // R6 and the second to last bank swap places in PRG mode 1
+    const bool prg_mode = map004_select & SELECT_PRG_MODE;
+    cart_map_prg_8k(prg_mode ? 2 : 0, map004_registers[6]);
+    cart_map_prg_8k(1, map004_registers[7]);
+    cart_map_prg_8k(prg_mode ? 0 : 2, -2);
+    cart_map_prg_8k(3, -1);
+
+    // R0/R1 are 2KB banks at $0000, R2-R5 1KB banks at $1000, swapped when A12 is inverted
+    const uint8_t invert = map004_select & SELECT_CHR_INVERT ? 4 : 0;
+    cart_map_chr_1k(0 ^ invert, map004_registers[0] & 0xFE);
+    cart_map_chr_1k(1 ^ invert, map004_registers[0] | 0x01);
+    cart_map_chr_1k(2 ^ invert, map004_registers[1] & 0xFE);
+    cart_map_chr_1k(3 ^ invert, map004_registers[1] | 0x01);
+    for (int i = 0; i < 4; i++)
+        cart_map_chr_1k((4 + i) ^ invert, map004_registers[2 + i]);
+}
+
+void write_004(const uint16_t addr, const uint8_t value) {
+    const bool odd = addr & 0x0001;
+    switch (addr & 0xE000) {
+        case 0x8000:
+            if (odd)
+                map004_registers[map004_select & SELECT_REGISTER] = value;
+            else
+                map004_select = value;
+            update_banks_004();
+            break;
+        case 0xA000:
+            // $A001 is PRG-RAM protect; MMC6 boards share the mapper number and use those bits differently, so the
+            // RAM is left enabled
+            if (!odd)
+                cart_set_mirror(value & 0x01 ? HORIZONTAL : VERTICAL);
+            break;
+        case 0xC000:
+            if (odd) {
+                map004_irq_counter = 0;
+                map004_irq_reload = true;
+            } else {
+                map004_irq_latch = value;
+            }
+            break;
+        case 0xE000:
+            map004_irq_enabled = odd;
+            if (!odd)
+                cpu_set_irq(IRQ_MAPPER, false);
+            break;
+        default:
+            break;
+    }
+}
+
+// Next rendered line's A12 edge. Lines are visited even with rendering off so turning it on is noticed by the next
+// line; the pattern table setup is read again when the edge comes.
+void schedule_edge_004(void) {
+    const int16_t edge = ppu_a12_edge_dot();
+    const int16_t dot = edge < 0 ? DEFAULT_EDGE_DOT : edge;
+    int16_t line = ppu_scanline();
+    if (line >= 240 || ppu_cycle() > dot)
+        line++;
+    if (line >= 240)
+        line = -1;
+    scheduler_schedule(EVENT_MAPPER, scheduler_now() + ppu_clocks_to_dot(line, dot));
+}
+
+void edge_004(const uint64_t time) {
+    (void)time;
+    if (ppu_a12_edge_dot() >= 0) {
+        if (map004_irq_counter == 0 || map004_irq_reload) {
+            map004_irq_counter = map004_irq_latch;
+            map004_irq_reload = false;
+        } else {
+            map004_irq_counter--;
+        }
+        if (map004_irq_counter == 0 && map004_irq_enabled)
+            cpu_set_irq(IRQ_MAPPER, true);
+    }
+    schedule_edge_004();
+}
+
+void reset_004(void) {
+    map004_irq_enabled = false;
+    map004_irq_reload = false;
+    map004_irq_counter = 0;
+    schedule_edge_004();
+}
+
+Mapper *new_mapper_004(CartridgeInfo *info) {
+    map004 = calloc(1, sizeof(Mapper));
+    map004->info = info;
+    map004->write = &write_004;
+    map004->event = &edge_004;
+    map004->reset = &reset_004;
+
+    map004_select = 0x00;
+    const uint8_t power_on[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+    for (int i = 0; i < 8; i++)
+        map004_registers[i] = power_on[i];
+    map004_irq_latch = 0x00;
+    update_banks_004();
+    return map004;
+}
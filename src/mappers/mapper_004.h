@@ -0,0 +1,8 @@
+#ifndef MAPPER_004_H
+#define MAPPER_004_H
+
+#include "mapper.h"
+
+Mapper *new_mapper_004(CartridgeInfo *info);
+
+#endif // MAPPER_004_H
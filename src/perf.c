@@ -0,0 +1,88 @@
+#include "perf.h"
+
+#ifdef ZNES_TIMING
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_READ_MISS(cache) ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+
+const char *counter_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+int perf_fds[PERF_COUNTER_COUNT] = {-1, -1, -1, -1, -1};
+
+// Opens every counter it can for this thread, user space only so it works with perf_event_paranoid up to 2. Returns
+// false if none could be opened.
+bool perf_open(void) {
+#ifdef __linux__
+    static const struct {
+        uint32_t type;
+        uint64_t config;
+    } events[PERF_COUNTER_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+        {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    perf_close();
+    bool any = false;
+    int error = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[i].type;
+        attr.config = events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf_fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (perf_fds[i] < 0)
+            error = errno;
+        else
+            any = true;
+    }
+    if (!any)
+        fprintf(stderr, "No hardware counters (%s), timing without them.\n", strerror(error));
+    else if (error != 0)
+        fprintf(stderr, "Some hardware counters are missing (%s), they read as zero.\n", strerror(error));
+    return any;
+#else
+    fprintf(stderr, "Hardware counters need Linux perf_event_open(), timing without them.\n");
+    return false;
+#endif
+}
+
+void perf_close(void) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+#ifdef __linux__
+        if (perf_fds[i] >= 0)
+            close(perf_fds[i]);
+#endif
+        perf_fds[i] = -1;
+    }
+}
+
+bool perf_counting(const PerfCounter counter) { return perf_fds[counter] >= 0; }
+
+// Running totals since perf_open(), callers subtract two readings
+void perf_read(uint64_t values[PERF_COUNTER_COUNT]) {
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        values[i] = 0;
+#ifdef __linux__
+        if (perf_fds[i] >= 0 && read(perf_fds[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+            values[i] = 0;
+#endif
+    }
+}
+
+const char *perf_counter_name(const PerfCounter counter) { return counter_names[counter]; }
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+
+// Host hardware counters through Linux perf_event_open(), read around each frame phase of the run loop by the timing
+// build (see timing.h). Counters the kernel or the CPU doesn't provide, inside most VMs for instance, stay closed and
+// read as zero; with none open everything else carries on without them.
+
+typedef enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES, // Read misses
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT,
+} PerfCounter;
+
+bool perf_open(void);
+void perf_close(void);
+bool perf_counting(PerfCounter counter);
+void perf_read(uint64_t values[PERF_COUNTER_COUNT]);
+const char *perf_counter_name(PerfCounter counter);
+
+#endif // PERF_H
@@ -1,10 +1,13 @@
 #include <raylib.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "bus.h"
 #include "cartridge.h"
+#include "cdl.h"
 #include "ppu.h"
+#include "ppu_deferred.h"
 
 #include <stdio.h>
 
@@ -38,15 +41,13 @@
 #define CONTROL_SPRITE_SIZE BIT_5
 #define CONTROL_ENABLE_NMI BIT_7
 
-#define VRAM_TO_UINT16 *(uint16_t *)
-
 uint8_t ppu_read(uint16_t addr);
 void ppu_write(uint16_t addr, uint8_t data);
 
 uint8_t ppu_cpu_read(uint16_t addr);
 void ppu_cpu_write(uint16_t addr, uint8_t data);
 
-PPU *ppu;
+thread_local PPU *ppu;
 
 Color NTSC[0x40] = {
     {84, 84, 84, 255},    {0, 30, 116, 255},    {8, 16, 144, 255},    {48, 0, 136, 255},    {68, 0, 100, 255},    {92, 0, 48, 255},
@@ -67,11 +68,14 @@ PPU *ppu_new() {
     ppu->read = &ppu_cpu_read;
     ppu->write = &ppu_cpu_write;
     ppu_reset();
-    ppu->texture_screen = LoadRenderTexture(256, 240);
-    ppu->texture_nametable[0] = LoadRenderTexture(256, 240);
-    ppu->texture_nametable[1] = LoadRenderTexture(256, 240);
-    ppu->texture_pattern[0] = LoadRenderTexture(128, 128);
-    ppu->texture_pattern[1] = LoadRenderTexture(128, 128);
+    // Headless runs have no GL context, the screen buffer is all they need
+    if (IsWindowReady()) {
+        ppu->texture_screen = LoadRenderTexture(256, 240);
+        ppu->texture_nametable[0] = LoadRenderTexture(256, 240);
+        ppu->texture_nametable[1] = LoadRenderTexture(256, 240);
+        ppu->texture_pattern[0] = LoadRenderTexture(128, 128);
+        ppu->texture_pattern[1] = LoadRenderTexture(128, 128);
+    }
     return ppu;
 }
 
@@ -85,6 +89,34 @@ void ppu_free(void) {
     ppu = nullptr;
 }
 
+// Copy of the current PPU state without the raylib textures, to be driven by another thread
+PPU *ppu_clone(void) {
+    PPU *clone = malloc(sizeof(PPU));
+    memcpy(clone, ppu, sizeof(PPU));
+    clone->OAM_pointer = (uint8_t *)clone->OAM;
+    clone->deferred = false;
+    clone->nmi = nullptr;
+    clone->status_changed = nullptr;
+    clone->texture_screen = (RenderTexture2D){0};
+    clone->texture_nametable[0] = (RenderTexture2D){0};
+    clone->texture_nametable[1] = (RenderTexture2D){0};
+    clone->texture_pattern[0] = (RenderTexture2D){0};
+    clone->texture_pattern[1] = (RenderTexture2D){0};
+    return clone;
+}
+
+// Copies the emulated state of src into dst without touching the screen buffer or the textures
+void ppu_copy_state(PPU *dst, const PPU *src) {
+    memcpy(dst, src, offsetof(PPU, texture_screen));
+    dst->OAM_pointer = (uint8_t *)dst->OAM;
+    dst->deferred = false;
+    dst->nmi = nullptr;
+    dst->status_changed = nullptr;
+}
+
+// Selects the PPU driven by ppu_clock() on the calling thread
+void ppu_bind(PPU *p) { ppu = p; }
+
 Color *get_color_by_index(const uint8_t index) { return &NTSC[index]; }
 
 void raylib_render_pattern_table(const uint8_t i, const uint8_t palette) {
@@ -209,6 +241,50 @@ uint8_t flip(uint8_t byte) {
     return (byte * 0x0202020202ULL & 0x010884422010ULL) % 1023;
 }
 
+// Pattern byte fetched for rendering, what the code/data log counts as rendered CHR
+uint8_t fetch_pattern(const uint16_t addr) {
+    if (cdl != nullptr)
+        cdl_chr(ppu->cart, addr, CDL_RENDERED);
+    return ppu_read(addr);
+}
+
+void fetch_background(const uint8_t step) {
+    switch (step) {
+        case 0:
+            load_shifters();
+            ppu->next_tile_id = ppu_read(0x2000 | (ppu->vram_addr.reg & 0x0FFF));
+            break;
+        case 2:
+            ppu->next_tile_attrib = ppu_read(0x23C0 | (ppu->vram_addr.nametable_y << 11) | ppu->vram_addr.nametable_x << 10 |
+                                             ppu->vram_addr.y >> 2 << 3 | ppu->vram_addr.x >> 2);
+            if (ppu->vram_addr.y & 0x02)
+                ppu->next_tile_attrib >>= 4;
+            if (ppu->vram_addr.x & 0x02)
+                ppu->next_tile_attrib >>= 2;
+            ppu->next_tile_attrib &= 0x03;
+            break;
+        case 4:
+            ppu->next_tile_lsb =
+                fetch_pattern(((ppu->control & CONTROL_PATTERN_BACKGROUND) << 8) + ((uint16_t)ppu->next_tile_id << 4) + ppu->vram_addr.fine_y);
+            break;
+        case 6:
+            ppu->next_tile_msb = fetch_pattern(((ppu->control & CONTROL_PATTERN_BACKGROUND) << 8) +
+                                               ((uint16_t)ppu->next_tile_id << 4) + ppu->vram_addr.fine_y + 8);
+            break;
+        default:
+            break;
+    }
+}
+
+// Status bits set or cleared by the PPU itself, a CPU spinning on $2002 has to see them change
+void update_status(const uint8_t status) {
+    if (status == ppu->status)
+        return;
+    ppu->status = status;
+    if (ppu->status_changed != nullptr)
+        ppu->status_changed();
+}
+
 void ppu_clock(void) {
     if (ppu->scanline >= -1 && ppu->scanline < 240) {
         if (ppu->scanline == 0 && ppu->cycle == 0) {
@@ -216,9 +292,7 @@ void ppu_clock(void) {
         }
 
         if (ppu->scanline == -1 && ppu->cycle == 1) {
-            ppu->status &= ~STATUS_VERTICAL_BLANK;
-            ppu->status &= ~STATUS_SPRITE_OVERFLOW;
-            ppu->status &= ~STATUS_SPRITE_ZERO_HIT;
+            update_status(ppu->status & ~(STATUS_VERTICAL_BLANK | STATUS_SPRITE_OVERFLOW | STATUS_SPRITE_ZERO_HIT));
             for (int i = 0; i < 8; i++) {
                 ppu->sprite_lo[i] = 0;
                 ppu->sprite_hi[i] = 0;
@@ -227,34 +301,11 @@ void ppu_clock(void) {
 
         if ((ppu->cycle >= 2 && ppu->cycle < 258) || (ppu->cycle >= 321 && ppu->cycle < 338)) {
             shift();
-            switch ((ppu->cycle - 1) % 8) {
-                case 0:
-                    load_shifters();
-                    ppu->next_tile_id = ppu_read(0x2000 | (VRAM_TO_UINT16 & ppu->vram_addr & 0x0FFF));
-                    break;
-                case 2:
-                    ppu->next_tile_attrib = ppu_read(0x23C0 | (ppu->vram_addr.nametable_y << 11) | ppu->vram_addr.nametable_x << 10 |
-                                                     ppu->vram_addr.y >> 2 << 3 | ppu->vram_addr.x >> 2);
-                    if (ppu->vram_addr.y & 0x02)
-                        ppu->next_tile_attrib >>= 4;
-                    if (ppu->vram_addr.x & 0x02)
-                        ppu->next_tile_attrib >>= 2;
-                    ppu->next_tile_attrib &= 0x03;
-                    break;
-                case 4:
-                    ppu->next_tile_lsb = ppu_read(((ppu->control & CONTROL_PATTERN_BACKGROUND) << 8) + ((uint16_t)ppu->next_tile_id << 4) +
-                                                  ppu->vram_addr.fine_y);
-                    break;
-                case 6:
-                    ppu->next_tile_msb = ppu_read(((ppu->control & CONTROL_PATTERN_BACKGROUND) << 8) + ((uint16_t)ppu->next_tile_id << 4) +
-                                                  ppu->vram_addr.fine_y + 8);
-                    break;
-                case 7:
-                    scroll_x();
-                    break;
-                default:
-                    break;
-            }
+            const uint8_t step = (ppu->cycle - 1) % 8;
+            if (step == 7)
+                scroll_x();
+            else if (!ppu->skip_render || ppu->can_zero_hit)
+                fetch_background(step);
         }
 
         if (ppu->cycle == 256) {
@@ -267,7 +318,7 @@ void ppu_clock(void) {
         }
 
         if (ppu->cycle == 338 || ppu->cycle == 340) {
-            ppu->next_tile_id = ppu_read(0x2000 | (VRAM_TO_UINT16 & ppu->vram_addr & 0x0FFF));
+            ppu->next_tile_id = ppu_read(0x2000 | (ppu->vram_addr.reg & 0x0FFF));
         }
 
         if (ppu->scanline == -1 && ppu->cycle >= 280 && ppu->cycle < 305) {
@@ -303,14 +354,16 @@ void ppu_clock(void) {
         }
 
         if (ppu->sprite_count > 8) {
-            ppu->status |= STATUS_SPRITE_OVERFLOW;
+            update_status(ppu->status | STATUS_SPRITE_OVERFLOW);
         } else {
-            ppu->status &= ~STATUS_SPRITE_OVERFLOW;
+            update_status(ppu->status & ~STATUS_SPRITE_OVERFLOW);
         }
     }
 
     if (ppu->cycle == 340) {
-        for (uint8_t i = 0; i < ppu->sprite_count; i++) {
+        // Without composition only sprite 0 is needed, and only on lines where it can hit
+        const uint8_t fetch_count = !ppu->skip_render ? ppu->sprite_count : ppu->can_zero_hit ? 1 : 0;
+        for (uint8_t i = 0; i < fetch_count; i++) {
             uint16_t sprite_pattern_addr_lo;
             const uint16_t y_position = ppu->scanline - ppu->sprite_data[i].y;
             const bool flipped_vertically = ppu->sprite_data[i].attribute & 0x80;
@@ -349,8 +402,8 @@ void ppu_clock(void) {
                 sprite_pattern_addr_lo = pattern_bank | tile | row_offset;
             }
             const uint16_t sprite_pattern_addr_hi = sprite_pattern_addr_lo + 8;
-            uint8_t sprite_pattern_bits_lo = ppu_read(sprite_pattern_addr_lo);
-            uint8_t sprite_pattern_bits_hi = ppu_read(sprite_pattern_addr_hi);
+            uint8_t sprite_pattern_bits_lo = fetch_pattern(sprite_pattern_addr_lo);
+            uint8_t sprite_pattern_bits_hi = fetch_pattern(sprite_pattern_addr_hi);
             if (ppu->sprite_data[i].attribute & 0x40) {
                 sprite_pattern_bits_lo = flip(sprite_pattern_bits_lo);
                 sprite_pattern_bits_hi = flip(sprite_pattern_bits_hi);
@@ -362,96 +415,96 @@ void ppu_clock(void) {
 
     if (ppu->scanline >= 241 && ppu->scanline < 261) {
         if (ppu->scanline == 241 && ppu->cycle == 1) {
-            ppu->status |= STATUS_VERTICAL_BLANK;
-            if (ppu->control & CONTROL_ENABLE_NMI)
-                ppu->nmi = true;
+            update_status(ppu->status | STATUS_VERTICAL_BLANK);
+            if ((ppu->control & CONTROL_ENABLE_NMI) && ppu->nmi != nullptr)
+                ppu->nmi();
         }
     }
 
-    // Background
-    uint8_t bg_pixel = 0x00;
-    uint8_t bg_palette = 0x00;
+    // Pixels are only needed on visible dots of a rendered frame, or to detect sprite 0 hit
+    const bool visible = ppu->scanline >= 0 && ppu->scanline < 240 && ppu->cycle >= 0 && ppu->cycle < 256;
+    const bool compose = visible && !ppu->skip_render;
 
-    if (ppu->mask & MASK_ENABLE_BACKGROUND) {
-        const uint16_t mask = 0x8000 >> ppu->fine_x;
+    if (compose || ppu->can_zero_hit) {
+        // Background
+        uint8_t bg_pixel = 0x00;
+        uint8_t bg_palette = 0x00;
 
-        const uint8_t p0 = (ppu->pattern_lo & mask) ? 1 : 0;
-        const uint8_t p1 = (ppu->pattern_hi & mask) ? 1 : 0;
-        bg_pixel = (p1 << 1) | p0;
+        if (ppu->mask & MASK_ENABLE_BACKGROUND) {
+            const uint16_t mask = 0x8000 >> ppu->fine_x;
 
-        const uint8_t bg0 = (ppu->attrib_lo & mask) ? 1 : 0;
-        const uint8_t bg1 = (ppu->attrib_hi & mask) ? 1 : 0;
-        bg_palette = (bg1 << 1) | bg0;
-    }
+            const uint8_t p0 = (ppu->pattern_lo & mask) ? 1 : 0;
+            const uint8_t p1 = (ppu->pattern_hi & mask) ? 1 : 0;
+            bg_pixel = (p1 << 1) | p0;
 
-    // Foreground
-    uint8_t fg_pixel = 0x00;
-    uint8_t fg_palette = 0x00;
-    uint8_t fg_priority = 0x00;
+            const uint8_t bg0 = (ppu->attrib_lo & mask) ? 1 : 0;
+            const uint8_t bg1 = (ppu->attrib_hi & mask) ? 1 : 0;
+            bg_palette = (bg1 << 1) | bg0;
+        }
 
-    if (ppu->mask & MASK_ENABLE_SPRITE) {
-        ppu->sprite_zero_rendering = false;
+        // Foreground
+        uint8_t fg_pixel = 0x00;
+        uint8_t fg_palette = 0x00;
+        uint8_t fg_priority = 0x00;
 
-        for (uint8_t i = 0; i < ppu->sprite_count; i++) {
-            if (ppu->sprite_data[i].x != 0) {
-                continue;
-            }
+        if (ppu->mask & MASK_ENABLE_SPRITE) {
+            ppu->sprite_zero_rendering = false;
 
-            const uint8_t fg_pixel_lo = (ppu->sprite_lo[i] & 0x80) ? 1 : 0;
-            const uint8_t fg_pixel_hi = (ppu->sprite_hi[i] & 0x80) ? 1 : 0;
-            const uint8_t pixel = (fg_pixel_hi << 1) | fg_pixel_lo;
+            for (uint8_t i = 0; i < ppu->sprite_count; i++) {
+                if (ppu->sprite_data[i].x != 0) {
+                    continue;
+                }
 
-            if (pixel == 0)
-                continue;
+                const uint8_t fg_pixel_lo = (ppu->sprite_lo[i] & 0x80) ? 1 : 0;
+                const uint8_t fg_pixel_hi = (ppu->sprite_hi[i] & 0x80) ? 1 : 0;
+                const uint8_t pixel = (fg_pixel_hi << 1) | fg_pixel_lo;
 
-            fg_pixel = pixel;
-            fg_palette = (ppu->sprite_data[i].attribute & 0x03) + 0x04;
-            fg_priority = (ppu->sprite_data[i].attribute & 0x20) == 0;
+                if (pixel == 0)
+                    continue;
 
-            if (i == 0)
-                ppu->sprite_zero_rendering = true;
+                fg_pixel = pixel;
+                fg_palette = (ppu->sprite_data[i].attribute & 0x03) + 0x04;
+                fg_priority = (ppu->sprite_data[i].attribute & 0x20) == 0;
 
-            break;
-        }
-    }
+                if (i == 0)
+                    ppu->sprite_zero_rendering = true;
 
-    uint8_t pixel = 0x00;
-    uint8_t palette = 0x00;
-
-    if (bg_pixel == 0 && fg_pixel == 0) {
-        pixel = 0x00;
-        palette = 0x00;
-    } else if (bg_pixel == 0 && fg_pixel > 0) {
-        pixel = fg_pixel;
-        palette = fg_palette;
-    } else if (bg_pixel > 0 && fg_pixel == 0) {
-        pixel = bg_pixel;
-        palette = bg_palette;
-    } else if (bg_pixel > 0 && fg_pixel > 0) {
-        if (fg_priority) {
-            pixel = fg_pixel;
-            palette = fg_palette;
-        } else {
-            pixel = bg_pixel;
-            palette = bg_palette;
+                break;
+            }
         }
 
-        if (ppu->can_zero_hit && ppu->sprite_zero_rendering) {
+        if (bg_pixel > 0 && fg_pixel > 0 && ppu->can_zero_hit && ppu->sprite_zero_rendering) {
             if (ppu->mask & (MASK_ENABLE_BACKGROUND | MASK_ENABLE_SPRITE)) {
                 const uint16_t min_visible_cycle = ppu->mask & (MASK_SHOW_BACKGROUND_LEFT | MASK_SHOW_SPRITE_LEFT) ? 1 : 9;
 
                 if (ppu->cycle >= min_visible_cycle && ppu->cycle < 258) {
-                    ppu->status |= STATUS_SPRITE_ZERO_HIT;
+                    update_status(ppu->status | STATUS_SPRITE_ZERO_HIT);
                 }
             }
         }
-    }
 
-    if (ppu->scanline >= 0 && ppu->scanline < 240 && ppu->cycle >= 0 && ppu->cycle < 256) {
-        // const Color color = get_color_from_palette_ram(palette, pixel);
-        // const int posY = (255 - ppu->scanline); // RayLib
-        // DrawPixel(ppu->cycle - 1, posY, color);
-        ppu->screen_buffer[ppu->cycle][ppu->scanline] = get_color_index_from_palette_ram(palette, pixel);
+        if (compose) {
+            uint8_t pixel = 0x00;
+            uint8_t palette = 0x00;
+
+            if (bg_pixel == 0 && fg_pixel > 0) {
+                pixel = fg_pixel;
+                palette = fg_palette;
+            } else if (bg_pixel > 0 && fg_pixel == 0) {
+                pixel = bg_pixel;
+                palette = bg_palette;
+            } else if (bg_pixel > 0 && fg_pixel > 0) {
+                if (fg_priority) {
+                    pixel = fg_pixel;
+                    palette = fg_palette;
+                } else {
+                    pixel = bg_pixel;
+                    palette = bg_palette;
+                }
+            }
+
+            ppu->screen_buffer[ppu->cycle][ppu->scanline] = get_color_index_from_palette_ram(palette, pixel);
+        }
     }
 
     ppu->cycle++;
@@ -461,12 +514,46 @@ void ppu_clock(void) {
         if (ppu->scanline >= 261) {
             ppu->scanline = -1;
             ppu->frame_complete = true;
+            if (ppu->deferred)
+                ppu_deferred_end_frame();
         }
+        if (ppu->deferred)
+            ppu_deferred_scanline();
     }
 }
 
+// Clocks until the PPU has run the given dot, the next time it gets there. A frame is 262 lines of 341 dots, one less
+// since dot 0 of line 0 is always skipped; that dot is never a target.
+uint32_t ppu_clocks_to_dot(const int16_t scanline, const int16_t cycle) {
+    constexpr uint32_t FRAME_DOTS = 262 * 341;
+    constexpr uint32_t SKIPPED_DOT = 341;
+    const uint32_t dot = (uint32_t)(ppu->scanline + 1) * 341 + ppu->cycle;
+    const uint32_t target = (uint32_t)(scanline + 1) * 341 + cycle;
+    if (target >= dot)
+        return target - dot + 1 - (dot <= SKIPPED_DOT && target > SKIPPED_DOT ? 1 : 0);
+    return FRAME_DOTS - dot + target + 1 - (dot <= SKIPPED_DOT || target > SKIPPED_DOT ? 1 : 0);
+}
+
+// Clocks left until the PPU wraps to the pre-render line and sets frame_complete
+uint32_t ppu_clocks_to_frame_end(void) { return ppu_clocks_to_dot(260, 340); }
+
+// Dot at which PPU A12 rises on a rendered line, -1 if rendering is off or every fetch is from $0000. Sprites are
+// fetched from dot 257 (in 8x16 mode empty slots come from $1000) and the next line's background from dot 321.
+int16_t ppu_a12_edge_dot(void) {
+    if (!(ppu->mask & (MASK_ENABLE_BACKGROUND | MASK_ENABLE_SPRITE)))
+        return -1;
+    if (ppu->control & (CONTROL_PATTERN_SPRITE | CONTROL_SPRITE_SIZE))
+        return 260;
+    if (ppu->control & CONTROL_PATTERN_BACKGROUND)
+        return 324;
+    return -1;
+}
+
+// Where the PPU is in the frame, scanline -1 is the pre-render line
+int16_t ppu_scanline(void) { return ppu->scanline; }
+int16_t ppu_cycle(void) { return ppu->cycle; }
+
 void ppu_reset(void) {
-    ppu->nmi = false;
     ppu->frame_complete = false;
     ppu->fine_x = 0x00;
     ppu->address_latch = 0x00;
@@ -484,8 +571,8 @@ void ppu_reset(void) {
     ppu->status = 0x00;
     ppu->mask = 0x00;
     ppu->control = 0x00;
-    VRAM_TO_UINT16 &ppu->vram_addr = 0x0000;
-    VRAM_TO_UINT16 &ppu->temp_vram_addr = 0x0000;
+    ppu->vram_addr.reg = 0x0000;
+    ppu->temp_vram_addr.reg = 0x0000;
     ppu->oam_addr = 0x00;
     ppu->can_zero_hit = false;
     ppu->sprite_zero_rendering = false;
@@ -527,7 +614,7 @@ uint8_t ppu_read(uint16_t addr) {
     addr &= 0x3FFF;
 
     if (addr <= 0x1FFF) {
-        data = ppu->cart->ppu_read(addr);
+        data = ppu->cart->chr_banks[addr >> 10][addr & 0x03FF];
     } else if (addr >= 0x2000 && addr <= 0x3EFF) {
         addr &= 0x0FFF;
 
@@ -551,6 +638,10 @@ uint8_t ppu_read(uint16_t addr) {
                 data = ppu->nametable[1][addr & 0x03FF];
             if (addr >= 0x0C00 && addr <= 0x0FFF)
                 data = ppu->nametable[1][addr & 0x03FF];
+        } else if (ppu->cart->mirror == ONESCREEN_LO) {
+            data = ppu->nametable[0][addr & 0x03FF];
+        } else if (ppu->cart->mirror == ONESCREEN_HI) {
+            data = ppu->nametable[1][addr & 0x03FF];
         }
     } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
         addr &= 0x001F;
@@ -595,6 +686,10 @@ void ppu_write(uint16_t addr, const uint8_t data) {
                 ppu->nametable[1][addr & 0x03FF] = data;
             if (addr >= 0x0C00 && addr <= 0x0FFF)
                 ppu->nametable[1][addr & 0x03FF] = data;
+        } else if (ppu->cart->mirror == ONESCREEN_LO) {
+            ppu->nametable[0][addr & 0x03FF] = data;
+        } else if (ppu->cart->mirror == ONESCREEN_HI) {
+            ppu->nametable[1][addr & 0x03FF] = data;
         }
     } else if (addr >= 0x3F00 && addr <= 0x3FFF) {
         uint8_t addr2 = (uint8_t)(addr & 0x001F);
@@ -612,6 +707,9 @@ void ppu_write(uint16_t addr, const uint8_t data) {
 
 uint8_t ppu_cpu_read(uint16_t addr) {
     uint8_t data = 0x00;
+    const uint16_t vram = ppu->vram_addr.reg; // $2007 reads it before stepping it
+    if (ppu->deferred && (addr == 0x0002 || addr == 0x0007))
+        ppu_deferred_log(PPU_LOG_READ, addr, 0x00);
     switch (addr) {
         case 0x0002:
             data = (ppu->status & 0xE0) | (ppu->data_buffer & 0x1F);
@@ -623,10 +721,12 @@ uint8_t ppu_cpu_read(uint16_t addr) {
             break;
         case 0x0007:
             data = ppu->data_buffer;
-            VRAM_TO_UINT16 &ppu->data_buffer = ppu_read(VRAM_TO_UINT16 & ppu->vram_addr);
-            if (VRAM_TO_UINT16 & ppu->vram_addr >= 0x3F00)
+            if (cdl != nullptr && (vram & 0x3FFF) <= 0x1FFF)
+                cdl_chr(ppu->cart, vram, CDL_READ);
+            ppu->data_buffer = ppu_read(vram);
+            if (vram >= 0x3F00)
                 data = ppu->data_buffer;
-            VRAM_TO_UINT16 &ppu->vram_addr += ((ppu->control & CONTROL_INCREMENT_MODE) ? 32 : 1);
+            ppu->vram_addr.reg += ((ppu->control & CONTROL_INCREMENT_MODE) ? 32 : 1);
             break;
         default:
             break;
@@ -635,6 +735,8 @@ uint8_t ppu_cpu_read(uint16_t addr) {
 }
 
 void ppu_cpu_write(uint16_t addr, uint8_t data) {
+    if (ppu->deferred)
+        ppu_deferred_log(PPU_LOG_WRITE, addr, data);
     switch (addr) {
         case 0x0000: // Control
             ppu->control = data;
@@ -663,17 +765,17 @@ void ppu_cpu_write(uint16_t addr, uint8_t data) {
             break;
         case 0x0006: // PPU Address
             if (ppu->address_latch == 0) {
-                VRAM_TO_UINT16 &ppu->temp_vram_addr = (uint16_t)((data & 0x3F) << 8) | (VRAM_TO_UINT16 & ppu->temp_vram_addr & 0x00FF);
+                ppu->temp_vram_addr.reg = (uint16_t)((data & 0x3F) << 8) | (ppu->temp_vram_addr.reg & 0x00FF);
                 ppu->address_latch = 1;
             } else {
-                VRAM_TO_UINT16 &ppu->temp_vram_addr = (VRAM_TO_UINT16 & ppu->temp_vram_addr & 0xFF00) | data;
+                ppu->temp_vram_addr.reg = (ppu->temp_vram_addr.reg & 0xFF00) | data;
                 ppu->vram_addr = ppu->temp_vram_addr;
                 ppu->address_latch = 0;
             }
             break;
         case 0x0007: // PPU Data
-            ppu_write(VRAM_TO_UINT16 & ppu->vram_addr, data);
-            VRAM_TO_UINT16 &ppu->vram_addr += ppu->control & CONTROL_INCREMENT_MODE ? 32 : 1;
+            ppu_write(ppu->vram_addr.reg, data);
+            ppu->vram_addr.reg += ppu->control & CONTROL_INCREMENT_MODE ? 32 : 1;
             break;
         default:
             break;
@@ -6,13 +6,17 @@
 
 #include "forward.h"
 
-typedef struct VRamAddr {
-    uint16_t x : 5;
-    uint16_t y : 5;
-    uint16_t nametable_x : 1;
-    uint16_t nametable_y : 1;
-    uint16_t fine_y : 3;
-    uint16_t unused : 1;
+// The loopy v/t registers, by field or as the whole 15-bit address through reg
+typedef union VRamAddr {
+    struct {
+        uint16_t x : 5;
+        uint16_t y : 5;
+        uint16_t nametable_x : 1;
+        uint16_t nametable_y : 1;
+        uint16_t fine_y : 3;
+        uint16_t unused : 1;
+    };
+    uint16_t reg;
 } VRamAddr;
 
 typedef struct Sprite {
@@ -55,8 +59,11 @@ struct PPU {
     uint16_t pattern_hi;
     uint16_t attrib_lo;
     uint16_t attrib_hi;
-    bool nmi;
+    void (*nmi)(void); // Raises the CPU NMI, nullptr on the copies replayed by the render threads
+    void (*status_changed)(void); // Wakes a CPU idling on $2002, nullptr on the copies like nmi
     bool frame_complete;
+    bool skip_render; // Keep timing, sprite 0 hit and VBlank but don't compose pixels
+    bool deferred;    // Register accesses are logged for the render thread (see ppu_deferred.h)
 
     Sprite OAM[64];
     uint8_t oam_addr;
@@ -70,6 +77,7 @@ struct PPU {
 
     uint8_t *OAM_pointer;
 
+    // Output only, everything above is emulated state copied by ppu_copy_state()
     RenderTexture2D texture_screen;
     uint8_t screen_buffer[256][240];
     RenderTexture2D texture_nametable[2];
@@ -78,12 +86,20 @@ struct PPU {
 
 PPU *ppu_new();
 void ppu_free(void);
+PPU *ppu_clone(void);
+void ppu_copy_state(PPU *dst, const PPU *src);
+void ppu_bind(PPU *p);
 
 Color *get_color_by_index(uint8_t index);
 
 void raylib_render_pattern_table(uint8_t i, uint8_t palette);
 
 void ppu_clock(void);
+uint32_t ppu_clocks_to_dot(int16_t scanline, int16_t cycle);
+uint32_t ppu_clocks_to_frame_end(void);
+int16_t ppu_a12_edge_dot(void);
+int16_t ppu_scanline(void);
+int16_t ppu_cycle(void);
 void ppu_reset(void);
 
 void gen_screen_texture(void);
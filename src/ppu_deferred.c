@@ -0,0 +1,270 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cartridge.h"
+#include "ppu.h"
+#include "ppu_deferred.h"
+#include "ppu_parallel.h"
+
+// Frames the emulation thread may run ahead of the render thread before it has to wait
+#define DEFERRED_QUEUE_SIZE 3
+
+typedef struct DeferredPPU {
+    PPU *timing;
+    PPU *shadow;
+    Cartridge *shadow_cart;
+
+    PPUFrameLog logs[DEFERRED_QUEUE_SIZE];
+    uint32_t head;  // Next log to be rendered
+    uint32_t tail;  // Log being filled by the emulation thread
+    uint32_t count; // Logs waiting to be rendered
+    bool render;
+    int bands; // 0 when frames are replayed on the render thread alone
+
+    void (*on_frame)(uint8_t frame[256][240]);
+    double render_seconds;
+    uint32_t rendered_frames;
+
+    uint8_t front[256][240];
+    bool running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} DeferredPPU;
+
+DeferredPPU *deferred;
+
+uint32_t frame_dot(const PPU *p) { return (uint32_t)(p->scanline + 1) * 341 + p->cycle; }
+
+// Applies a logged access to p, which must be the PPU bound on the calling thread
+void ppu_deferred_apply(PPU *p, const PPULogEntry *entry) {
+    switch (entry->type) {
+        case PPU_LOG_WRITE:
+            p->write(entry->addr, entry->data);
+            break;
+        case PPU_LOG_READ:
+            p->read(entry->addr);
+            break;
+        case PPU_LOG_OAM:
+            p->OAM_pointer[entry->addr] = entry->data;
+            break;
+        case PPU_LOG_MIRROR:
+            p->cart->mirror = entry->data;
+            break;
+        case PPU_LOG_CHR_BANK:
+            p->cart->chr_banks[entry->addr] = &p->cart->chr[entry->data * CHR_BANK_SIZE];
+            break;
+        default:
+            break;
+    }
+}
+
+void replay_frame(const PPUFrameLog *log) {
+    PPU *shadow = deferred->shadow;
+    shadow->skip_render = !log->render;
+
+    for (uint32_t i = 0; i < log->count; i++) {
+        const PPULogEntry *entry = &log->entries[i];
+        while (frame_dot(shadow) < entry->dot)
+            ppu_clock();
+        ppu_deferred_apply(shadow, entry);
+    }
+
+    while (!shadow->frame_complete)
+        ppu_clock();
+    shadow->frame_complete = false;
+}
+
+void *render_thread(void *arg) {
+    (void)arg;
+    ppu_bind(deferred->shadow);
+    cartridge_bind(deferred->shadow_cart);
+
+    pthread_mutex_lock(&deferred->lock);
+    for (;;) {
+        while (deferred->count == 0 && deferred->running)
+            pthread_cond_wait(&deferred->cond, &deferred->lock);
+        if (deferred->count == 0)
+            break;
+
+        const PPUFrameLog *log = &deferred->logs[deferred->head];
+        pthread_mutex_unlock(&deferred->lock);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // Only the log that was open when the thread started lacks snapshots, the shadow PPU is in sync for that one.
+        // With a full set of snapshots a frame no longer depends on the previous one and skipped frames cost nothing.
+        if (deferred->bands > 0 && log->snapshot_count == deferred->bands) {
+            if (log->render)
+                ppu_parallel_render(log, deferred->bands, deferred->shadow->screen_buffer);
+        } else {
+            replay_frame(log);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        if (log->render && deferred->on_frame != nullptr)
+            deferred->on_frame(deferred->shadow->screen_buffer);
+
+        pthread_mutex_lock(&deferred->lock);
+        if (log->render) {
+            memcpy(deferred->front, deferred->shadow->screen_buffer, sizeof(deferred->front));
+            deferred->render_seconds += (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+            deferred->rendered_frames++;
+        }
+        deferred->head = (deferred->head + 1) % DEFERRED_QUEUE_SIZE;
+        deferred->count--;
+        pthread_cond_broadcast(&deferred->cond);
+    }
+    pthread_mutex_unlock(&deferred->lock);
+    return nullptr;
+}
+
+void start_thread(PPU *timing) {
+    deferred->timing = timing;
+    deferred->shadow = ppu_clone();
+    deferred->shadow_cart = cartridge_clone(timing->cart);
+    deferred->shadow->cart = deferred->shadow_cart;
+    deferred->head = 0;
+    deferred->tail = 0;
+    deferred->count = 0;
+    deferred->logs[0].count = 0;
+    deferred->logs[0].render = deferred->render;
+    deferred->logs[0].snapshot_count = 0;
+    deferred->running = true;
+
+    timing->skip_render = true;
+    timing->deferred = true;
+    pthread_create(&deferred->thread, nullptr, &render_thread, nullptr);
+}
+
+void stop_thread(void) {
+    pthread_mutex_lock(&deferred->lock);
+    deferred->running = false;
+    pthread_cond_broadcast(&deferred->cond);
+    pthread_mutex_unlock(&deferred->lock);
+    pthread_join(deferred->thread, nullptr);
+
+    deferred->timing->deferred = false;
+    deferred->timing->skip_render = false;
+    cartridge_free_clone(deferred->shadow_cart);
+    free(deferred->shadow);
+}
+
+// Must be called on the emulation thread, after bus_reset() and set_cart(). With more than one render thread frames
+// are split in bands rendered in parallel (see ppu_parallel.h).
+void ppu_deferred_start(PPU *timing, const int render_threads) {
+    deferred = calloc(1, sizeof(DeferredPPU));
+    if (render_threads > 1) {
+        ppu_parallel_start(render_threads);
+        deferred->bands = render_threads * 2 < PPU_MAX_BANDS ? render_threads * 2 : PPU_MAX_BANDS;
+    }
+    for (int i = 0; i < DEFERRED_QUEUE_SIZE; i++) {
+        deferred->logs[i].capacity = 1024;
+        deferred->logs[i].entries = malloc(deferred->logs[i].capacity * sizeof(PPULogEntry));
+        for (int b = 0; b < deferred->bands; b++) {
+            deferred->logs[i].snapshots[b].ppu = malloc(sizeof(PPU));
+            deferred->logs[i].snapshots[b].cart = cartridge_clone(timing->cart);
+        }
+    }
+    deferred->render = true;
+    pthread_mutex_init(&deferred->lock, nullptr);
+    pthread_cond_init(&deferred->cond, nullptr);
+    start_thread(timing);
+}
+
+void ppu_deferred_stop(void) {
+    if (deferred == nullptr)
+        return;
+
+    stop_thread();
+    if (deferred->bands > 0)
+        ppu_parallel_stop();
+    for (int i = 0; i < DEFERRED_QUEUE_SIZE; i++) {
+        free(deferred->logs[i].entries);
+        for (int b = 0; b < deferred->bands; b++) {
+            free(deferred->logs[i].snapshots[b].ppu);
+            cartridge_free_clone(deferred->logs[i].snapshots[b].cart);
+        }
+    }
+    pthread_mutex_destroy(&deferred->lock);
+    pthread_cond_destroy(&deferred->cond);
+    free(deferred);
+    deferred = nullptr;
+}
+
+// The emulated PPU state was changed behind the log's back (reset), render from a fresh copy of it
+void ppu_deferred_resync(void) {
+    if (deferred == nullptr)
+        return;
+
+    PPU *timing = deferred->timing;
+    stop_thread();
+    start_thread(timing);
+}
+
+bool ppu_deferred_active(void) { return deferred != nullptr; }
+
+void ppu_deferred_set_render(const bool render) {
+    deferred->render = render;
+    deferred->logs[deferred->tail].render = render;
+}
+
+void ppu_deferred_log(const PPULogType type, const uint8_t addr, const uint8_t data) {
+    PPUFrameLog *log = &deferred->logs[deferred->tail];
+    if (log->count == log->capacity) {
+        log->capacity *= 2;
+        log->entries = realloc(log->entries, log->capacity * sizeof(PPULogEntry));
+    }
+    log->entries[log->count++] = (PPULogEntry){frame_dot(deferred->timing), type, addr, data};
+}
+
+// Called by the timing PPU at the start of every scanline. The line before each band is where that band's renderer
+// has to start from: that is when the background prefetch and sprite evaluation for the band's first line happen.
+void ppu_deferred_scanline(void) {
+    PPUFrameLog *log = &deferred->logs[deferred->tail];
+    if (log->snapshot_count == deferred->bands)
+        return;
+    if (deferred->timing->scanline + 1 != ppu_parallel_band_start(log->snapshot_count, deferred->bands))
+        return;
+
+    const PPUSnapshot *snapshot = &log->snapshots[log->snapshot_count++];
+    ppu_copy_state(snapshot->ppu, deferred->timing);
+    cartridge_copy_state(snapshot->cart, deferred->timing->cart);
+    snapshot->ppu->cart = snapshot->cart;
+}
+
+// Called by the timing PPU when it wraps to the pre-render line. Hands the finished log to the render thread and
+// waits only if it is a whole queue of frames behind.
+void ppu_deferred_end_frame(void) {
+    pthread_mutex_lock(&deferred->lock);
+    deferred->tail = (deferred->tail + 1) % DEFERRED_QUEUE_SIZE;
+    deferred->count++;
+    pthread_cond_broadcast(&deferred->cond);
+    while (deferred->count == DEFERRED_QUEUE_SIZE)
+        pthread_cond_wait(&deferred->cond, &deferred->lock);
+    pthread_mutex_unlock(&deferred->lock);
+
+    deferred->logs[deferred->tail].count = 0;
+    deferred->logs[deferred->tail].render = deferred->render;
+    deferred->logs[deferred->tail].snapshot_count = 0;
+}
+
+// Copies the last frame finished by the render thread to the PPU screen buffer used by gen_screen_texture()
+void ppu_deferred_present(void) {
+    pthread_mutex_lock(&deferred->lock);
+    memcpy(deferred->timing->screen_buffer, deferred->front, sizeof(deferred->front));
+    pthread_mutex_unlock(&deferred->lock);
+}
+
+// Called on the render thread with every finished frame, e.g. to capture video in headless runs
+void ppu_deferred_set_frame_callback(void (*callback)(uint8_t frame[256][240])) { deferred->on_frame = callback; }
+
+// Average time the render thread spent producing a frame
+double ppu_deferred_render_ms(void) {
+    pthread_mutex_lock(&deferred->lock);
+    const double ms = deferred->rendered_frames > 0 ? deferred->render_seconds * 1000.0 / deferred->rendered_frames : 0.0;
+    pthread_mutex_unlock(&deferred->lock);
+    return ms;
+}
@@ -0,0 +1,61 @@
+#ifndef PPU_DEFERRED_H
+#define PPU_DEFERRED_H
+
+#include <stdint.h>
+
+#include "forward.h"
+
+// Deferred PPU: the emulation thread runs the PPU for timing only (VBlank, NMI, sprite 0 hit) and logs every access
+// that can change what ends up on screen. A render thread replays the log against its own copy of the PPU and builds
+// the frame while the emulation thread is already running the next one.
+
+typedef enum PPULogType {
+    PPU_LOG_WRITE,    // CPU write to $2000-$2007
+    PPU_LOG_READ,     // CPU read with side effects ($2002, $2007)
+    PPU_LOG_OAM,      // OAM DMA byte
+    PPU_LOG_MIRROR,   // Mapper changed nametable mirroring
+    PPU_LOG_CHR_BANK, // Mapper switched a 1KB CHR slot (addr) to another bank (data)
+} PPULogType;
+
+typedef struct PPULogEntry {
+    uint32_t dot; // PPU clocks since the start of the frame
+    uint8_t type;
+    uint8_t addr;
+    uint8_t data;
+} PPULogEntry;
+
+// Most bands a frame can be split in for the parallel renderer (see ppu_parallel.h)
+#define PPU_MAX_BANDS 16
+
+// PPU and cartridge state one scanline before a band starts, taken by the timing PPU
+typedef struct PPUSnapshot {
+    PPU *ppu;
+    Cartridge *cart;
+} PPUSnapshot;
+
+typedef struct PPUFrameLog {
+    PPULogEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    bool render;
+    PPUSnapshot snapshots[PPU_MAX_BANDS];
+    uint8_t snapshot_count;
+} PPUFrameLog;
+
+void ppu_deferred_start(PPU *timing, int render_threads);
+void ppu_deferred_stop(void);
+void ppu_deferred_resync(void);
+bool ppu_deferred_active(void);
+
+void ppu_deferred_set_render(bool render);
+void ppu_deferred_log(PPULogType type, uint8_t addr, uint8_t data);
+void ppu_deferred_scanline(void);
+void ppu_deferred_end_frame(void);
+void ppu_deferred_present(void);
+void ppu_deferred_set_frame_callback(void (*callback)(uint8_t frame[256][240]));
+double ppu_deferred_render_ms(void);
+
+uint32_t frame_dot(const PPU *p);
+void ppu_deferred_apply(PPU *p, const PPULogEntry *entry);
+
+#endif // PPU_DEFERRED_H
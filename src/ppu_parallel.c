@@ -0,0 +1,148 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartridge.h"
+#include "ppu.h"
+#include "ppu_parallel.h"
+
+typedef struct PPUPool {
+    pthread_t *threads;
+    int workers;
+
+    // Current job, only changed while every worker is idle
+    const PPUFrameLog *log;
+    int bands;
+    uint8_t (*out)[240];
+
+    atomic_int next_band; // Shared band counter, every worker takes the next band from it until they run out
+    int pending;          // Bands not finished yet
+    uint32_t generation;  // Bumped for every job so sleeping workers know there is new work
+    bool running;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+} PPUPool;
+
+PPUPool *pool;
+
+int16_t ppu_parallel_band_start(const int band, const int bands) { return (int16_t)(band * 240 / bands); }
+
+// Renders one band on the calling thread. The snapshot PPU is consumed: it is clocked from the line before the band
+// up to the band's last line, then the band's rows are copied to the output.
+void render_band(const PPUFrameLog *log, const int band) {
+    const PPUSnapshot *snapshot = &log->snapshots[band];
+    PPU *p = snapshot->ppu;
+    const int16_t first = ppu_parallel_band_start(band, pool->bands);
+    const int16_t last = ppu_parallel_band_start(band + 1, pool->bands);
+    const uint32_t end = (uint32_t)(last + 1) * 341;
+
+    ppu_bind(p);
+    cartridge_bind(snapshot->cart);
+    p->skip_render = false;
+
+    // Entries are in dot order, find the first one that belongs to this band
+    uint32_t lo = 0;
+    uint32_t hi = log->count;
+    const uint32_t start = frame_dot(p);
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (log->entries[mid].dot < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (uint32_t i = lo; i < log->count && log->entries[i].dot < end; i++) {
+        while (frame_dot(p) < log->entries[i].dot)
+            ppu_clock();
+        ppu_deferred_apply(p, &log->entries[i]);
+    }
+    while (frame_dot(p) < end)
+        ppu_clock();
+
+    for (int x = 0; x < 256; x++)
+        memcpy(&pool->out[x][first], &p->screen_buffer[x][first], last - first);
+}
+
+// Takes bands off the shared counter until none are left, returns how many this thread did
+int render_bands(void) {
+    int rendered = 0;
+    for (;;) {
+        const int band = atomic_fetch_add(&pool->next_band, 1);
+        if (band >= pool->bands)
+            return rendered;
+        render_band(pool->log, band);
+        rendered++;
+    }
+}
+
+void *worker_thread(void *arg) {
+    (void)arg;
+    uint32_t seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && pool->running)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (!pool->running)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        const int rendered = render_bands();
+
+        pthread_mutex_lock(&pool->lock);
+        pool->pending -= rendered;
+        if (pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return nullptr;
+}
+
+void ppu_parallel_start(const int workers) {
+    pool = calloc(1, sizeof(PPUPool));
+    pool->workers = workers;
+    pool->threads = calloc(workers, sizeof(pthread_t));
+    pool->running = true;
+    pthread_mutex_init(&pool->lock, nullptr);
+    pthread_cond_init(&pool->work, nullptr);
+    pthread_cond_init(&pool->done, nullptr);
+    for (int i = 0; i < workers; i++)
+        pthread_create(&pool->threads[i], nullptr, &worker_thread, nullptr);
+}
+
+void ppu_parallel_stop(void) {
+    pthread_mutex_lock(&pool->lock);
+    pool->running = false;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->workers; i++)
+        pthread_join(pool->threads[i], nullptr);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+    pool = nullptr;
+}
+
+// Renders a frame whose log has a snapshot for every band and waits for it. Leaves the calling thread's ppu and cart
+// bindings untouched.
+void ppu_parallel_render(const PPUFrameLog *log, const int bands, uint8_t out[256][240]) {
+    pthread_mutex_lock(&pool->lock);
+    pool->log = log;
+    pool->bands = bands;
+    pool->out = out;
+    pool->pending = bands;
+    atomic_store(&pool->next_band, 0);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,19 @@
+#ifndef PPU_PARALLEL_H
+#define PPU_PARALLEL_H
+
+#include <stdint.h>
+
+#include "forward.h"
+#include "ppu_deferred.h"
+
+// Parallel frame rendering for the deferred PPU. A frame is cut in bands of scanlines; each band starts from the
+// snapshot the timing PPU took one line before it and replays only its own slice of the register log, so bands
+// can be rendered in any order by a pool of worker threads.
+
+void ppu_parallel_start(int workers);
+void ppu_parallel_stop(void);
+
+int16_t ppu_parallel_band_start(int band, int bands);
+void ppu_parallel_render(const PPUFrameLog *log, int bands, uint8_t out[256][240]);
+
+#endif // PPU_PARALLEL_H
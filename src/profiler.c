@@ -0,0 +1,199 @@
+#include "profiler.h"
+
+#ifdef ZNES_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cartridge.h"
+#include "cpu.h"
+
+#define PROFILE_LOW_SIZE 0x8000
+
+Profiler *profiler;
+
+void profiler_start(const Cartridge *cart) {
+    profiler_stop();
+    profiler = calloc(1, sizeof(Profiler));
+    profiler->prg_size = cart->pgr_size;
+    profiler->entries = calloc(cart->pgr_size + PROFILE_LOW_SIZE, sizeof(ProfileEntry));
+    profiler->pair_count = calloc(256 * 256, sizeof(uint64_t));
+    profiler->triples = calloc(PROFILE_TRIPLE_SLOTS, sizeof(ProfileTriple));
+}
+
+void profiler_stop(void) {
+    if (profiler == nullptr)
+        return;
+    free(profiler->entries);
+    free(profiler->pair_count);
+    free(profiler->triples);
+    free(profiler);
+    profiler = nullptr;
+}
+
+// A full table drops new triples, the common ones are in long before that
+void count_triple(const uint32_t key) {
+    uint32_t slot = (key * 2654435761u) >> 16;
+    for (uint32_t probe = 0; probe < PROFILE_TRIPLE_SLOTS; probe++, slot = (slot + 1) & (PROFILE_TRIPLE_SLOTS - 1)) {
+        ProfileTriple *triple = &profiler->triples[slot];
+        if (triple->key == key || triple->key == 0) {
+            triple->key = key;
+            triple->count++;
+            return;
+        }
+    }
+}
+
+void profiler_record(const uint16_t pc, const uint16_t next_pc, const uint8_t opcode, const uint8_t cycles) {
+    if (profiler == nullptr)
+        return;
+    const uint32_t index = pc >= 0x8000 ? cart_prg_offset(pc) : profiler->prg_size + pc;
+    ProfileEntry *entry = &profiler->entries[index];
+    entry->count++;
+    entry->cycles += cycles;
+    entry->pc = pc;
+    profiler->opcode_count[opcode]++;
+    profiler->opcode_cycles[opcode] += cycles;
+    profiler->instructions++;
+    profiler->cycles += cycles;
+
+    if (pc != profiler->next_pc)
+        profiler->sequence_length = 0;
+    if (profiler->sequence_length >= 1)
+        profiler->pair_count[profiler->sequence[1] << 8 | opcode]++;
+    if (profiler->sequence_length == 2)
+        count_triple(1u << 24 | profiler->sequence[0] << 16 | profiler->sequence[1] << 8 | opcode);
+    profiler->sequence[0] = profiler->sequence[1];
+    profiler->sequence[1] = opcode;
+    if (profiler->sequence_length < 2)
+        profiler->sequence_length++;
+    profiler->next_pc = next_pc;
+}
+
+int compare_entries(const void *a, const void *b) {
+    const ProfileEntry *x = *(ProfileEntry *const *)a;
+    const ProfileEntry *y = *(ProfileEntry *const *)b;
+    return x->cycles < y->cycles ? 1 : x->cycles > y->cycles ? -1 : 0;
+}
+
+int compare_counts(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a;
+    const uint64_t y = *(const uint64_t *)b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int compare_opcodes(const void *a, const void *b) {
+    const uint64_t x = profiler->opcode_cycles[*(const uint8_t *)a];
+    const uint64_t y = profiler->opcode_cycles[*(const uint8_t *)b];
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Disassembles from PRG-ROM for banked code, from the bus for RAM; side effect free either way since only RAM and
+// $6000-$7FFF run code below $8000
+void describe_entry(const ProfileEntry *entry, Bus *bus, char *location, char *text) {
+    const uint32_t index = (uint32_t)(entry - profiler->entries);
+    uint8_t bytes[3] = {0};
+    if (index < profiler->prg_size) {
+        for (uint32_t i = 0; i < 3 && index + i < profiler->prg_size; i++)
+            bytes[i] = bus->cart->pgr[index + i];
+        sprintf(location, "%02X:$%04X", index / PRG_BANK_SIZE, entry->pc);
+    } else {
+        for (uint16_t i = 0; i < 3; i++)
+            bytes[i] = bus->read(entry->pc + i);
+        sprintf(location, "--:$%04X", entry->pc);
+    }
+    disasm_bytes(entry->pc, bytes, text, 64);
+}
+
+// One line per sequence, "$A5 $D0  count  %  LDA {ZP0} / BNE {REL}"
+void report_sequence(FILE *out, const uint32_t key, const uint8_t length, const uint64_t count) {
+    char codes[16] = "";
+    char names[64] = "";
+    for (uint8_t i = 0; i < length; i++) {
+        const uint8_t bytes[3] = {(uint8_t)(key >> (8 * (length - 1 - i))), 0, 0};
+        char text[64];
+        disasm_bytes(0, bytes, text, sizeof(text));
+        const char *mode = strchr(text, '{');
+        sprintf(codes + strlen(codes), "%s$%02X", i > 0 ? " " : "", bytes[0]);
+        snprintf(names + strlen(names), sizeof(names) - strlen(names), "%s%.3s %s", i > 0 ? " / " : "", text,
+                 mode != nullptr ? mode : "");
+    }
+    fprintf(out, "%-12s %14llu %6.2f%%  %s\n", codes, (unsigned long long)count,
+            100.0 * (double)count / (double)profiler->instructions, names);
+}
+
+// The `top` most frequent pairs and triples. Counts are packed with their key in the low bits to sort them together.
+void report_sequences(FILE *out, const uint32_t top) {
+    uint64_t *sorted = malloc(PROFILE_TRIPLE_SLOTS * sizeof(uint64_t));
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < 256 * 256; i++) {
+        if (profiler->pair_count[i] > 0)
+            sorted[used++] = profiler->pair_count[i] << 16 | i;
+    }
+    qsort(sorted, used, sizeof(uint64_t), &compare_counts);
+    fprintf(out, "\n%-12s %14s %7s\n", "pair", "count", "%");
+    for (uint32_t i = 0; i < used && i < top; i++)
+        report_sequence(out, sorted[i] & 0xFFFF, 2, sorted[i] >> 16);
+
+    used = 0;
+    for (uint32_t i = 0; i < PROFILE_TRIPLE_SLOTS; i++) {
+        if (profiler->triples[i].key != 0)
+            sorted[used++] = profiler->triples[i].count << 24 | (profiler->triples[i].key & 0xFFFFFF);
+    }
+    qsort(sorted, used, sizeof(uint64_t), &compare_counts);
+    fprintf(out, "\n%-12s %14s %7s\n", "triple", "count", "%");
+    for (uint32_t i = 0; i < used && i < top; i++)
+        report_sequence(out, sorted[i] & 0xFFFFFF, 3, sorted[i] >> 24);
+    free(sorted);
+}
+
+// Hottest PCs by cycles, every opcode that ran, then the most frequent opcode sequences. Banks are 8KB PRG-ROM banks.
+void profiler_report(FILE *out, Bus *bus, const uint32_t top) {
+    if (profiler == nullptr || profiler->instructions == 0)
+        return;
+
+    const uint32_t size = profiler->prg_size + PROFILE_LOW_SIZE;
+    ProfileEntry **hot = malloc(size * sizeof(ProfileEntry *));
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < size; i++)
+        if (profiler->entries[i].count > 0)
+            hot[used++] = &profiler->entries[i];
+    qsort(hot, used, sizeof(ProfileEntry *), &compare_entries);
+
+    fprintf(out, "%llu instructions, %llu cycles, %u distinct PCs\n", (unsigned long long)profiler->instructions,
+            (unsigned long long)profiler->cycles, used);
+    fprintf(out, "\n%-10s %12s %14s %7s %7s  %s\n", "bank:PC", "count", "cycles", "%", "cum %", "instruction");
+    double cumulative = 0.0;
+    for (uint32_t i = 0; i < used && i < top; i++) {
+        char location[16], text[64];
+        describe_entry(hot[i], bus, location, text);
+        const double share = 100.0 * (double)hot[i]->cycles / (double)profiler->cycles;
+        cumulative += share;
+        fprintf(out, "%-10s %12llu %14llu %6.2f%% %6.2f%%  %s\n", location, (unsigned long long)hot[i]->count,
+                (unsigned long long)hot[i]->cycles, share, cumulative, text);
+    }
+    free(hot);
+
+    uint8_t opcodes[256];
+    for (int i = 0; i < 256; i++)
+        opcodes[i] = (uint8_t)i;
+    qsort(opcodes, 256, 1, &compare_opcodes);
+
+    fprintf(out, "\n%-4s %-4s %14s %14s %7s %7s\n", "op", "name", "count", "cycles", "%", "avg");
+    for (int i = 0; i < 256 && profiler->opcode_count[opcodes[i]] > 0; i++) {
+        const uint8_t op = opcodes[i];
+        char text[64];
+        const uint8_t bytes[3] = {op, 0, 0};
+        disasm_bytes(0, bytes, text, sizeof(text));
+        const char *mode = strchr(text, '{');
+        fprintf(out, "$%02X  %-4.3s %14llu %14llu %6.2f%% %7.2f  %s\n", op, text,
+                (unsigned long long)profiler->opcode_count[op], (unsigned long long)profiler->opcode_cycles[op],
+                100.0 * (double)profiler->opcode_cycles[op] / (double)profiler->cycles,
+                (double)profiler->opcode_cycles[op] / (double)profiler->opcode_count[op], mode != nullptr ? mode : "");
+    }
+
+    report_sequences(out, top);
+}
+
+#endif
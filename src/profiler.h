@@ -0,0 +1,56 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "forward.h"
+
+// Guest execution profiler, only built with -DZNES_PROFILE=ON so the default build doesn't pay for it. Counts
+// instructions and cycles per opcode and per PC; PCs in $8000-$FFFF are counted by PRG-ROM offset so code in
+// different banks at the same address stays apart. Opcode pairs and triples that run back to back are counted too,
+// the hot instruction sequences of a game.
+#ifdef ZNES_PROFILE
+
+// Open addressed on the three opcodes, key 0 for a free slot
+#define PROFILE_TRIPLE_SLOTS (1 << 16)
+
+typedef struct ProfileEntry {
+    uint64_t count;
+    uint64_t cycles;
+    uint16_t pc; // CPU address it last ran at
+} ProfileEntry;
+
+typedef struct ProfileTriple {
+    uint32_t key; // 1 << 24 | first << 16 | second << 8 | third
+    uint64_t count;
+} ProfileTriple;
+
+typedef struct Profiler {
+    ProfileEntry *entries; // PRG-ROM offsets, then $0000-$7FFF
+    uint32_t prg_size;
+    uint64_t opcode_count[256];
+    uint64_t opcode_cycles[256];
+    uint64_t instructions;
+    uint64_t cycles;
+    uint64_t *pair_count; // first << 8 | second
+    ProfileTriple *triples;
+    uint16_t next_pc;    // Where the last instruction went, anything else means an interrupt came in between
+    uint8_t sequence[2]; // Opcodes of the last two instructions
+    uint8_t sequence_length;
+} Profiler;
+
+void profiler_start(const Cartridge *cart);
+void profiler_stop(void);
+void profiler_record(uint16_t pc, uint16_t next_pc, uint8_t opcode, uint8_t cycles);
+void profiler_report(FILE *out, Bus *bus, uint32_t top);
+
+#define PROFILE_RECORD(pc, next_pc, opcode, cycles) profiler_record(pc, next_pc, opcode, cycles)
+
+#else
+
+#define PROFILE_RECORD(pc, next_pc, opcode, cycles) ((void)(pc), (void)(next_pc), (void)(opcode), (void)(cycles))
+
+#endif
+
+#endif // PROFILER_H
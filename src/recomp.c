@@ -0,0 +1,29 @@
+#include <stdio.h>
+
+#include "recomp.h"
+
+#include "cartridge.h"
+
+// Modules linked into one binary, one per translated rom
+#define RECOMP_MAX_ROMS 32
+
+const RecompiledRom *recomp_roms[RECOMP_MAX_ROMS];
+uint32_t recomp_rom_count;
+
+// Called by each generated module before main()
+void recomp_register(const RecompiledRom *rom) {
+    if (recomp_rom_count == RECOMP_MAX_ROMS) {
+        fprintf(stderr, "Too many recompiled roms, %s stays interpreted.\n", rom->name);
+        return;
+    }
+    recomp_roms[recomp_rom_count++] = rom;
+}
+
+const RecompiledRom *recomp_find(const Cartridge *cart) {
+    for (uint32_t i = 0; i < recomp_rom_count; i++) {
+        const RecompiledRom *rom = recomp_roms[i];
+        if (rom->crc32 == cart->info->crc32 && rom->prg_size == cart->pgr_size)
+            return rom;
+    }
+    return nullptr;
+}
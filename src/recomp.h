@@ -0,0 +1,52 @@
+#ifndef RECOMP_H
+#define RECOMP_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+#include "forward.h"
+
+// Ahead of time translated PRG-ROM, written by tools/znes_recomp.c. A module holds one C function per instruction the
+// tool found reachable, keyed by PRG-ROM offset. The decode cache runs it in place of the addressing mode and opcode
+// handlers; everything else, including code the tool couldn't reach, stays interpreted.
+
+// Runs the instruction with its operand folded in, the PC already past it and cpu->cycles set to its base count.
+// Returns the extra cycle of a page crossing read.
+typedef uint8_t (*RecompiledFn)(void);
+
+typedef struct RecompiledOp {
+    uint32_t offset; // In PRG-ROM
+    RecompiledFn run;
+} RecompiledOp;
+
+typedef struct RecompiledRom {
+    const char *name;
+    uint32_t crc32; // PRG + CHR-ROM, the same as CartridgeInfo's
+    uint32_t prg_size;
+    uint32_t count;
+    const RecompiledOp *ops;
+} RecompiledRom;
+
+void recomp_register(const RecompiledRom *rom);
+const RecompiledRom *recomp_find(const Cartridge *cart);
+
+// What the generated code runs on, the same functions the interpreter uses
+
+extern Cpu *cpu;
+
+uint8_t cpu_read(uint16_t addr);
+void cpu_write(uint16_t addr, uint8_t data);
+void push_byte(uint8_t value);
+void push_word(uint16_t value);
+uint8_t pop_byte(void);
+uint16_t pop_word(void);
+
+static inline void recomp_nz(const uint8_t value) {
+    cpu->status = (cpu->status & ~(Z | N)) | (value == 0 ? Z : 0) | (value & N);
+}
+
+static inline void recomp_carry(const bool value) { cpu->status = (cpu->status & ~C) | (value ? C : 0); }
+
+static inline void recomp_overflow(const bool value) { cpu->status = (cpu->status & ~V) | (value ? V : 0); }
+
+#endif // RECOMP_H
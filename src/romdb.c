@@ -0,0 +1,32 @@
+#include <string.h>
+
+#include "romdb.h"
+
+#include "crc32.h"
+
+// romdb_entries[] grouped by bucket (the low ROMDB_BUCKET_BITS of the CRC), romdb_buckets[b] is the first entry of
+// bucket b and romdb_buckets[b + 1] one past its last
+#include "romdb_data.inc"
+
+// Hashes data and returns its database entry, nullptr if it isn't a known dump. crc_out gets the CRC32 if not nullptr.
+const RomDbEntry *romdb_lookup(const uint8_t *data, const size_t len, uint32_t *crc_out) {
+    const uint32_t crc = crc32(0, data, len);
+    if (crc_out != nullptr)
+        *crc_out = crc;
+
+    const uint32_t bucket = crc & ((1u << ROMDB_BUCKET_BITS) - 1);
+    uint8_t digest[SHA1_DIGEST_SIZE];
+    bool hashed = false;
+    for (uint32_t i = romdb_buckets[bucket]; i < romdb_buckets[bucket + 1]; i++) {
+        const RomDbEntry *entry = &romdb_entries[i];
+        if (entry->crc32 != crc || entry->prg_rom_size + (size_t)entry->chr_rom_size != len)
+            continue;
+        if (!hashed) {
+            sha1(data, len, digest);
+            hashed = true;
+        }
+        if (memcmp(digest, entry->sha1, SHA1_DIGEST_SIZE) == 0)
+            return entry;
+    }
+    return nullptr;
+}
@@ -0,0 +1,28 @@
+#ifndef ROMDB_H
+#define ROMDB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sha1.h"
+
+// Board information for known dumps, compiled in from tools/romdb_gen.py. Entries are keyed by the CRC32 of PRG and
+// CHR-ROM, the SHA-1 is only computed to confirm a CRC hit.
+
+typedef struct RomDbEntry {
+    uint32_t crc32;
+    uint8_t sha1[SHA1_DIGEST_SIZE];
+    uint32_t prg_rom_size;
+    uint32_t chr_rom_size;
+    uint16_t mapper;
+    uint8_t submapper;
+    uint8_t mirror;          // MirroringType
+    uint8_t timing;          // TimingType
+    uint8_t prg_ram_shift;   // NES 2.0 style sizes: 64 << shift bytes, 0 for none
+    uint8_t prg_nvram_shift;
+    uint8_t chr_ram_shift;
+} RomDbEntry;
+
+const RomDbEntry *romdb_lookup(const uint8_t *data, size_t len, uint32_t *crc_out);
+
+#endif // ROMDB_H
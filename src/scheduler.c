@@ -0,0 +1,103 @@
+#include <stdlib.h>
+
+#include "scheduler.h"
+
+Scheduler *scheduler;
+
+Scheduler *scheduler_new(void) {
+    scheduler = calloc(1, sizeof(Scheduler));
+    scheduler->now = 0;
+    scheduler->next = UINT64_MAX;
+    for (int i = 0; i < EVENT_COUNT; i++)
+        scheduler->slot[i] = -1;
+    return scheduler;
+}
+
+void scheduler_free(void) {
+    free(scheduler);
+    scheduler = nullptr;
+}
+
+uint64_t scheduler_now(void) { return scheduler->now; }
+
+void scheduler_set_handler(const EventType type, void (*handler)(uint64_t time)) { scheduler->handlers[type] = handler; }
+
+void heap_swap(const uint8_t a, const uint8_t b) {
+    const Event tmp = scheduler->heap[a];
+    scheduler->heap[a] = scheduler->heap[b];
+    scheduler->heap[b] = tmp;
+    scheduler->slot[scheduler->heap[a].type] = (int8_t)a;
+    scheduler->slot[scheduler->heap[b].type] = (int8_t)b;
+}
+
+void sift_up(uint8_t i) {
+    while (i > 0) {
+        const uint8_t parent = (i - 1) / 2;
+        if (scheduler->heap[parent].time <= scheduler->heap[i].time)
+            break;
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+void sift_down(uint8_t i) {
+    for (;;) {
+        const uint8_t left = 2 * i + 1;
+        const uint8_t right = left + 1;
+        uint8_t smallest = i;
+        if (left < scheduler->size && scheduler->heap[left].time < scheduler->heap[smallest].time)
+            smallest = left;
+        if (right < scheduler->size && scheduler->heap[right].time < scheduler->heap[smallest].time)
+            smallest = right;
+        if (smallest == i)
+            break;
+        heap_swap(i, smallest);
+        i = smallest;
+    }
+}
+
+void update_next(void) { scheduler->next = scheduler->size > 0 ? scheduler->heap[0].time : UINT64_MAX; }
+
+// Each event type is pending at most once, scheduling it again moves it to the new time
+void scheduler_schedule(const EventType type, const uint64_t time) {
+    int8_t i = scheduler->slot[type];
+    if (i < 0) {
+        i = (int8_t)scheduler->size++;
+        scheduler->slot[type] = i;
+        scheduler->heap[i] = (Event){time, type};
+        sift_up(i);
+    } else {
+        const uint64_t old = scheduler->heap[i].time;
+        scheduler->heap[i].time = time;
+        if (time < old)
+            sift_up(i);
+        else
+            sift_down(i);
+    }
+    update_next();
+}
+
+void scheduler_cancel(const EventType type) {
+    const int8_t i = scheduler->slot[type];
+    if (i < 0)
+        return;
+
+    const uint8_t last = --scheduler->size;
+    if (i != last) {
+        heap_swap(i, last);
+        sift_down(i);
+        sift_up(i);
+    }
+    scheduler->slot[type] = -1;
+    update_next();
+}
+
+// Runs every event due at or before now, earliest first. Handlers may schedule new events, including ones due now.
+void scheduler_dispatch(void) {
+    while (scheduler->size > 0 && scheduler->heap[0].time <= scheduler->now) {
+        const Event event = scheduler->heap[0];
+        scheduler_cancel(event.type);
+        if (scheduler->handlers[event.type] != nullptr)
+            scheduler->handlers[event.type](event.time);
+    }
+}
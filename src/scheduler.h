@@ -0,0 +1,46 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#include "forward.h"
+
+// Everything that has to happen at a given master clock goes through here instead of being polled every clock. The
+// run loop executes clocks straight-line until `next`, then dispatches whatever is due.
+
+typedef enum EventType {
+    EVENT_NMI,           // PPU raised NMI
+    EVENT_MAPPER,        // Mapper timer, e.g. the MMC3 scanline counter clocked by PPU A12
+    EVENT_DMA,           // Next byte of an OAM DMA from an I/O page
+    EVENT_FRAME_COUNTER, // APU frame counter quarter/half frame
+    EVENT_SAMPLE,        // Audio sample due
+    EVENT_FRAME_END,     // PPU wraps to the pre-render line, ends bus_run_frame()
+    EVENT_COUNT,
+} EventType;
+
+typedef struct Event {
+    uint64_t time;
+    EventType type;
+} Event;
+
+struct Scheduler {
+    uint64_t now;  // Master clocks since power on
+    uint64_t next; // Time of the earliest pending event, UINT64_MAX if there is none
+
+    Event heap[EVENT_COUNT];
+    int8_t slot[EVENT_COUNT]; // Heap index of each event type, -1 when it is not pending
+    uint8_t size;
+
+    void (*handlers[EVENT_COUNT])(uint64_t time);
+};
+
+Scheduler *scheduler_new(void);
+void scheduler_free(void);
+
+uint64_t scheduler_now(void);
+void scheduler_set_handler(EventType type, void (*handler)(uint64_t time));
+void scheduler_schedule(EventType type, uint64_t time);
+void scheduler_cancel(EventType type);
+void scheduler_dispatch(void);
+
+#endif // SCHEDULER_H
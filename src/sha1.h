@@ -0,0 +1,11 @@
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_DIGEST_SIZE 20
+
+void sha1(const uint8_t *data, size_t len, uint8_t digest[SHA1_DIGEST_SIZE]);
+
+#endif // SHA1_H
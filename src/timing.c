@@ -0,0 +1,183 @@
+#include "timing.h"
+
+#ifdef ZNES_TIMING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+Timing timing = {.countdown = TIMING_SAMPLE_PERIOD};
+
+const char *phase_names[PHASE_COUNT] = {"cpu", "ppu", "apu", "dma", "textures", "debugger", "present"};
+const char *loop_phase_names[LOOP_PHASE_COUNT] = {"emulation", "textures", "debugger", "present"};
+
+uint64_t timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void timing_add(const TimingPhase phase, const uint64_t start) { timing.current.ns[phase] += timing_now() - start; }
+
+void timing_open_counters(void) { timing.counting = perf_open(); }
+
+// Starts a loop phase, they follow each other without nesting
+void timing_begin(void) {
+    if (timing.counting)
+        perf_read(timing.counters_start);
+    timing.loop_start = timing_now();
+}
+
+void timing_end(const LoopPhase phase) {
+    const uint64_t ns = timing_now() - timing.loop_start;
+    if (phase == LOOP_EMULATION)
+        timing.emulation_ns += ns;
+    else
+        timing.current.ns[PHASE_TEXTURES + phase - LOOP_TEXTURES] += ns;
+    if (!timing.counting)
+        return;
+    uint64_t counters[PERF_COUNTER_COUNT];
+    perf_read(counters);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        timing.current.counters[phase][i] += counters[i] - timing.counters_start[i];
+}
+
+// Splits the emulation time left after APU and DMA between CPU and PPU, then files the frame
+void timing_end_frame(void) {
+    FrameTiming *frame = &timing.current;
+    const uint64_t direct = (uint64_t)frame->ns[PHASE_APU] + frame->ns[PHASE_DMA];
+    const uint64_t rest = timing.emulation_ns > direct ? timing.emulation_ns - direct : 0;
+    const uint64_t sampled = timing.sampled[PHASE_CPU] + timing.sampled[PHASE_PPU];
+    if (sampled > 0) {
+        frame->ns[PHASE_CPU] = rest * timing.sampled[PHASE_CPU] / sampled;
+        frame->ns[PHASE_PPU] = rest - frame->ns[PHASE_CPU];
+    }
+
+    timing.frames[timing.frame_count % TIMING_FRAMES] = *frame;
+    timing.frame_count++;
+    memset(&timing.current, 0, sizeof(timing.current));
+    memset(timing.sampled, 0, sizeof(timing.sampled));
+    timing.emulation_ns = 0;
+}
+
+int compare_ns(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Over the last TIMING_WINDOW frames, in milliseconds
+void timing_summary(const TimingPhase phase, double *p50, double *p99, double *max) {
+    uint32_t ns[TIMING_WINDOW];
+    const uint32_t count = timing.frame_count < TIMING_WINDOW ? (uint32_t)timing.frame_count : TIMING_WINDOW;
+    *p50 = *p99 = *max = 0.0;
+    if (count == 0)
+        return;
+    for (uint32_t i = 0; i < count; i++)
+        ns[i] = timing.frames[(timing.frame_count - 1 - i) % TIMING_FRAMES].ns[phase];
+    qsort(ns, count, sizeof(uint32_t), &compare_ns);
+    *p50 = ns[count / 2] / 1e6;
+    *p99 = ns[(count * 99 - 1) / 100] / 1e6;
+    *max = ns[count - 1] / 1e6;
+}
+
+// Mean per frame over the last TIMING_WINDOW frames
+void timing_counters_summary(const LoopPhase phase, double per_frame[PERF_COUNTER_COUNT]) {
+    const uint32_t count = timing.frame_count < TIMING_WINDOW ? (uint32_t)timing.frame_count : TIMING_WINDOW;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        uint64_t sum = 0;
+        for (uint32_t f = 0; f < count; f++)
+            sum += timing.frames[(timing.frame_count - 1 - f) % TIMING_FRAMES].counters[phase][i];
+        per_frame[i] = count > 0 ? (double)sum / count : 0.0;
+    }
+}
+
+// IPC and misses per frame of every loop phase that ran, over the last TIMING_WINDOW frames
+void timing_print_counters(FILE *out) {
+    if (!timing.counting)
+        return;
+    fprintf(out, "%-10s %6s %12s %12s %12s\n", "per frame", "IPC", "L1d misses", "LLC misses", "br misses");
+    for (int p = 0; p < LOOP_PHASE_COUNT; p++) {
+        double per_frame[PERF_COUNTER_COUNT];
+        timing_counters_summary(p, per_frame);
+        if (per_frame[PERF_CYCLES] == 0.0 && per_frame[PERF_INSTRUCTIONS] == 0.0)
+            continue;
+        fprintf(out, "%-10s %6.2f %12.0f %12.0f %12.0f\n", loop_phase_names[p],
+                per_frame[PERF_CYCLES] > 0 ? per_frame[PERF_INSTRUCTIONS] / per_frame[PERF_CYCLES] : 0.0,
+                per_frame[PERF_L1D_MISSES], per_frame[PERF_LLC_MISSES], per_frame[PERF_BRANCH_MISSES]);
+    }
+}
+
+const char *timing_phase_name(const TimingPhase phase) { return phase_names[phase]; }
+
+const char *timing_loop_phase_name(const LoopPhase phase) { return loop_phase_names[phase]; }
+
+// Writes the frames still in the ring, oldest first, as JSON if the path ends in .json and as CSV otherwise. Counter
+// columns are only there when the counters were open.
+bool timing_export(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", path);
+        return false;
+    }
+    const size_t length = strlen(path);
+    const bool json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+    const uint64_t first = timing.frame_count > TIMING_FRAMES ? timing.frame_count - TIMING_FRAMES : 0;
+
+    if (json) {
+        fprintf(out, "{\n  \"unit\": \"ns\",\n  \"phases\": [");
+        for (int p = 0; p < PHASE_COUNT; p++)
+            fprintf(out, "%s\"%s\"", p > 0 ? ", " : "", phase_names[p]);
+        fprintf(out, "],\n");
+        if (timing.counting) {
+            fprintf(out, "  \"counters\": [");
+            for (int p = 0; p < LOOP_PHASE_COUNT; p++)
+                for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+                    fprintf(out, "%s\"%s_%s\"", p + i > 0 ? ", " : "", loop_phase_names[p], perf_counter_name(i));
+            fprintf(out, "],\n");
+        }
+        fprintf(out, "  \"frames\": [\n");
+    } else {
+        fprintf(out, "frame");
+        for (int p = 0; p < PHASE_COUNT; p++)
+            fprintf(out, ",%s_ns", phase_names[p]);
+        for (int p = 0; timing.counting && p < LOOP_PHASE_COUNT; p++)
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+                fprintf(out, ",%s_%s", loop_phase_names[p], perf_counter_name(i));
+        fprintf(out, "\n");
+    }
+    for (uint64_t f = first; f < timing.frame_count; f++) {
+        const FrameTiming *frame = &timing.frames[f % TIMING_FRAMES];
+        if (json) {
+            fprintf(out, "    {\"frame\": %llu, \"ns\": [", (unsigned long long)f);
+            for (int p = 0; p < PHASE_COUNT; p++)
+                fprintf(out, "%s%u", p > 0 ? ", " : "", frame->ns[p]);
+            if (timing.counting) {
+                fprintf(out, "], \"counters\": [");
+                for (int p = 0; p < LOOP_PHASE_COUNT; p++)
+                    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+                        fprintf(out, "%s%llu", p + i > 0 ? ", " : "", (unsigned long long)frame->counters[p][i]);
+            }
+            fprintf(out, "]}%s\n", f + 1 < timing.frame_count ? "," : "");
+        } else {
+            fprintf(out, "%llu", (unsigned long long)f);
+            for (int p = 0; p < PHASE_COUNT; p++)
+                fprintf(out, ",%u", frame->ns[p]);
+            for (int p = 0; timing.counting && p < LOOP_PHASE_COUNT; p++)
+                for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+                    fprintf(out, ",%llu", (unsigned long long)frame->counters[p][i]);
+            fprintf(out, "\n");
+        }
+    }
+    if (json)
+        fprintf(out, "  ]\n}\n");
+
+    const bool ok = ferror(out) == 0;
+    fclose(out);
+    if (!ok)
+        fprintf(stderr, "Error writing %s.\n", path);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "perf.h"
+
+// Host time spent per frame in each phase of the run loop, only built with -DZNES_TIMING=ON so the default build
+// doesn't pay for it. The CPU and PPU are clocked interleaved one master clock at a time, far too often to read a
+// clock around each; instead every TIMING_SAMPLE_PERIOD-th clock is timed piece by piece and the emulation time left
+// after APU and DMA is split between them in that ratio. Everything else is timed directly. With --perf, hardware
+// counters are read around the run loop's own phases too: emulation as a whole, textures, debugger and present.
+
+typedef enum TimingPhase {
+    PHASE_CPU,
+    PHASE_PPU,
+    PHASE_APU,      // apu_run_until(), wherever it is called from
+    PHASE_DMA,      // OAM DMA copies and cycles
+    PHASE_TEXTURES, // Screen and pattern table textures
+    PHASE_DEBUGGER, // Registers, code, palettes and pattern tables next to the screen
+    PHASE_PRESENT,  // Drawing the screen and EndDrawing(), waiting for the frame deadline included
+    PHASE_COUNT,
+} TimingPhase;
+
+// What the hardware counters are read around, bus_run_frame() and the loop phases after it
+typedef enum LoopPhase {
+    LOOP_EMULATION,
+    LOOP_TEXTURES,
+    LOOP_DEBUGGER,
+    LOOP_PRESENT,
+    LOOP_PHASE_COUNT,
+} LoopPhase;
+
+#ifdef ZNES_TIMING
+
+// Frames kept for the export, a minute at 60 fps; the overlay only looks at the last TIMING_WINDOW
+#define TIMING_FRAMES 3600
+#define TIMING_WINDOW 120
+#define TIMING_SAMPLE_PERIOD 64
+
+typedef struct FrameTiming {
+    uint32_t ns[PHASE_COUNT];
+    uint64_t counters[LOOP_PHASE_COUNT][PERF_COUNTER_COUNT];
+} FrameTiming;
+
+typedef struct Timing {
+    FrameTiming frames[TIMING_FRAMES]; // Ring, frame n at n % TIMING_FRAMES
+    uint64_t frame_count;
+    FrameTiming current;
+    uint64_t emulation_ns;        // bus_run_frame() as a whole, CPU, PPU, APU and DMA
+    uint64_t sampled[PHASE_COUNT]; // CPU and PPU time in the sampled clocks
+    uint32_t countdown;            // Clocks until the next sampled one
+    bool counting;                 // Hardware counters are open
+    uint64_t loop_start;           // Time and counters when the current loop phase began
+    uint64_t counters_start[PERF_COUNTER_COUNT];
+} Timing;
+
+extern Timing timing;
+
+uint64_t timing_now(void);
+void timing_add(TimingPhase phase, uint64_t start);
+void timing_open_counters(void);
+void timing_begin(void);
+void timing_end(LoopPhase phase);
+void timing_end_frame(void);
+void timing_summary(TimingPhase phase, double *p50, double *p99, double *max);
+void timing_counters_summary(LoopPhase phase, double per_frame[PERF_COUNTER_COUNT]);
+void timing_print_counters(FILE *out);
+const char *timing_phase_name(TimingPhase phase);
+const char *timing_loop_phase_name(LoopPhase phase);
+bool timing_export(const char *path);
+
+#define TIMING_START(start) const uint64_t start = timing_now()
+#define TIMING_ADD(phase, start) timing_add(phase, start)
+#define TIMING_BEGIN() timing_begin()
+#define TIMING_END(phase) timing_end(phase)
+#define TIMING_END_FRAME() timing_end_frame()
+#define TIMING_SAMPLE_DUE() (--timing.countdown == 0)
+
+#else
+
+#define TIMING_START(start)
+#define TIMING_ADD(phase, start)
+#define TIMING_BEGIN()
+#define TIMING_END(phase)
+#define TIMING_END_FRAME()
+
+#endif
+
+#endif // TIMING_H
@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+Trace *trace;
+
+const int crash_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+bool write_all(const int fd, const void *data, size_t size) {
+    const uint8_t *p = data;
+    while (size > 0) {
+        const ssize_t written = write(fd, p, size);
+        if (written <= 0)
+            return false;
+        p += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Header and records oldest first. Only write() and no allocation, the crash handler uses it too.
+bool write_trace(const int fd, const char *reason) {
+    TraceHeader header = {.version = TRACE_VERSION, .record_size = sizeof(TraceRecord)};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.count = trace->count < TRACE_RECORDS ? trace->count : TRACE_RECORDS;
+    header.first = trace->count - header.count;
+    for (size_t i = 0; i < sizeof(header.reason) - 1 && reason[i] != '\0'; i++)
+        header.reason[i] = reason[i];
+
+    const uint64_t start = header.first % TRACE_RECORDS;
+    const uint64_t before_wrap = header.count < TRACE_RECORDS - start ? header.count : TRACE_RECORDS - start;
+    return write_all(fd, &header, sizeof(header)) &&
+           write_all(fd, &trace->records[start], before_wrap * sizeof(TraceRecord)) &&
+           write_all(fd, trace->records, (header.count - before_wrap) * sizeof(TraceRecord));
+}
+
+void crash_handler(const int sig) {
+    const int fd = open(trace->crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        write_trace(fd, "crash");
+        close(fd);
+        const char message[] = "Crashed, instruction trace written.\n";
+        const ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+        (void)written;
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Starts recording into a fresh ring. Dumps go to `path`, then `path`.1, .2...; a crash's to `path`.crash.
+void trace_start(const char *path, const int32_t trigger_pc, const int16_t *scanline, const int16_t *dot) {
+    trace_stop();
+    trace = calloc(1, sizeof(Trace));
+    trace->records = calloc(TRACE_RECORDS, sizeof(TraceRecord));
+    trace->scanline = scanline;
+    trace->dot = dot;
+    trace->trigger_pc = trigger_pc;
+    trace->path = strdup(path);
+    trace->crash_path = malloc(strlen(path) + 7);
+    sprintf(trace->crash_path, "%s.crash", path);
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        signal(crash_signals[i], &crash_handler);
+}
+
+void trace_stop(void) {
+    if (trace == nullptr)
+        return;
+    for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+        signal(crash_signals[i], SIG_DFL);
+    free(trace->records);
+    free(trace->path);
+    free(trace->crash_path);
+    free(trace);
+    trace = nullptr;
+}
+
+bool trace_dump(const char *reason) {
+    if (trace == nullptr)
+        return false;
+    char path[4096];
+    if (trace->dumps == 0)
+        snprintf(path, sizeof(path), "%s", trace->path);
+    else
+        snprintf(path, sizeof(path), "%s.%u", trace->path, trace->dumps);
+    trace->dumps++;
+
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s.\n", path);
+        return false;
+    }
+    const bool ok = write_trace(fd, reason);
+    close(fd);
+    if (!ok) {
+        fprintf(stderr, "Error writing %s.\n", path);
+        return false;
+    }
+    const uint64_t count = trace->count < TRACE_RECORDS ? trace->count : TRACE_RECORDS;
+    fprintf(stderr, "Trace of the last %llu instructions written to %s (%s).\n", (unsigned long long)count, path,
+            reason);
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Binary instruction trace: cpu_clock() writes one fixed-size record per instruction into a ring, with the state before
+// the instruction runs, and nothing is formatted until tools/trace_decode.c turns a dump into nestest-style text. A
+// dump is written on demand, on exit, the first time the trigger PC is reached, on the first run of an unknown opcode
+// and when the emulator crashes. A CPU skipping an idle loop has no records until it wakes up.
+
+// Records kept, the last ~100 frames of a typical game
+#define TRACE_RECORDS (1 << 20)
+#define TRACE_MAGIC "ZNTR"
+#define TRACE_VERSION 1
+
+typedef struct TraceRecord {
+    uint64_t clock;     // Master clocks since power on, CPU cycles are a third of that
+    uint16_t pc;
+    int16_t scanline;   // -1 for the pre-render line
+    uint16_t dot;
+    uint8_t opcode;
+    uint8_t operand[2]; // Only as many as the instruction has are meaningful
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t status;
+    uint8_t sp;
+} TraceRecord;
+
+// Dump file header, the records follow oldest first
+typedef struct TraceHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+    uint64_t count; // Records in the file
+    uint64_t first; // Instructions traced before the first of them, dropped from the ring
+    char reason[32];
+} TraceHeader;
+
+typedef struct Trace {
+    TraceRecord *records;
+    uint64_t count;          // Records written, the ring holds the last TRACE_RECORDS
+    const int16_t *scanline; // Where the PPU is, read for every record
+    const int16_t *dot;
+    int32_t trigger_pc; // Dumps once the CPU gets here, -1 for none or once it has
+    char *path;
+    char *crash_path; // Made up front, the crash handler can't allocate
+    uint32_t dumps;
+} Trace;
+
+extern Trace *trace;
+
+void trace_start(const char *path, int32_t trigger_pc, const int16_t *scanline, const int16_t *dot);
+void trace_stop(void);
+bool trace_dump(const char *reason);
+
+#endif // TRACE_H
@@ -0,0 +1,309 @@
+// znes-cpu-bench: times the CPU core one opcode at a time.
+//
+// usage: znes-cpu-bench [--cycles N] [--filter TEXT]
+//
+// Each case is a synthetic mapper 000 rom whose code at $8000 repeats one instruction and jumps back, so the time per
+// instruction is that opcode's dispatch, operand fetch and handler with nothing else mixed in. Every opcode and
+// addressing mode in lut gets a case, the indexed reads also one crossing a page, and branches, jumps, JSR/RTS and
+// BRK/RTI get their own. Only cpu_clock() runs, the PPU and APU aren't clocked; idle loop skipping is off so a short
+// loop isn't skipped instead of timed. Compare the output of two builds to catch a per-opcode regression.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bus.h"
+#include "cartridge.h"
+#include "cpu.h"
+
+#define PRG_SIZE (32 * 1024)
+#define CHR_SIZE (8 * 1024)
+
+// Repeated instructions fill this many bytes from $8000 before the jump back
+#define BODY_SIZE 1024
+
+// Operands: zero page data, pointers for the indirect modes and the RAM the absolute modes read and write
+#define ZP_DATA 0x80
+#define ZP_POINTER 0x20      // -> $0300
+#define ZP_POINTER_PAGE 0x40 // -> $03F8, crosses a page once Y is added
+#define ABS_DATA 0x0300
+#define ABS_DATA_PAGE 0x03F8
+#define INDEX 0x10
+#define JMP_POINTERS 0x0500 // JMP (ind) chain, one pointer per jump
+#define JMP_COUNT (BODY_SIZE / 3)
+
+#define SUBROUTINE 0xF000 // RTS, for JSR
+#define IRQ_HANDLER 0xF100 // RTI, for BRK
+
+#define DEFAULT_CYCLES 20000000
+#define CALIBRATE_INSTRUCTIONS 20000
+
+uint8_t prg[PRG_SIZE];
+uint64_t cycles_per_case = DEFAULT_CYCLES;
+const char *filter;
+uint32_t case_count;
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The image goes through a temporary file, the cartridge maps roms from files
+Cartridge *load_prg(void) {
+    char path[] = "/tmp/znes-cpu-bench-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating a temporary rom.\n");
+        return nullptr;
+    }
+    INesHeader header = {.magic = {'N', 'E', 'S', 0x1A}, .prg_rom_pages = PRG_SIZE / (16 * 1024), .chr_rom_pages = 1};
+    static const uint8_t chr[CHR_SIZE];
+    FILE *file = fdopen(fd, "wb");
+    const bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(prg, PRG_SIZE, 1, file) == 1 &&
+                         fwrite(chr, CHR_SIZE, 1, file) == 1;
+    fclose(file);
+    Cartridge *cart = written ? cartridge_new(path) : nullptr;
+    unlink(path);
+    return cart;
+}
+
+void put_word(const uint16_t addr, const uint16_t value) {
+    prg[addr - 0x8000] = value & 0xFF;
+    prg[addr - 0x8000 + 1] = value >> 8;
+}
+
+// A fresh image: vectors to $8000 and the handlers
+void clear_prg(void) {
+    memset(prg, 0xEA, PRG_SIZE); // NOP
+    prg[SUBROUTINE - 0x8000] = 0x60;  // RTS
+    prg[IRQ_HANDLER - 0x8000] = 0x40; // RTI
+    put_word(0xFFFA, 0x8000);
+    put_word(0xFFFC, 0x8000);
+    put_word(0xFFFE, IRQ_HANDLER);
+}
+
+// Fills the body with one instruction, then jumps back to $8000
+void repeat(const uint8_t *bytes, const uint8_t length) {
+    uint16_t at = 0x8000;
+    while (at + length <= 0x8000 + BODY_SIZE) {
+        memcpy(&prg[at - 0x8000], bytes, length);
+        at += length;
+    }
+    const uint8_t jump[3] = {0x4C, 0x00, 0x80};
+    memcpy(&prg[at - 0x8000], jump, sizeof(jump));
+}
+
+// Runs the image from `start` and prints one line. The cycles per instruction come from a short run that steps
+// instruction by instruction, the timed run then only calls cpu_clock().
+void run_case(const char *name, const uint16_t start, const uint8_t status) {
+    if (filter != nullptr && strstr(name, filter) == nullptr)
+        return;
+    Cartridge *cart = load_prg();
+    if (cart == nullptr)
+        exit(1);
+    Bus *bus = bus_new();
+    bus->cpu->idle_skip = false;
+    set_cart(cart);
+    bus_reset();
+
+    bus->ram[ZP_POINTER] = ABS_DATA & 0xFF;
+    bus->ram[ZP_POINTER + 1] = ABS_DATA >> 8;
+    bus->ram[ZP_POINTER_PAGE] = ABS_DATA_PAGE & 0xFF;
+    bus->ram[ZP_POINTER_PAGE + 1] = ABS_DATA_PAGE >> 8;
+    for (uint16_t i = 0; i < JMP_COUNT; i++) {
+        const uint16_t next = i + 1 < JMP_COUNT ? 0x8000 + (i + 1) * 3 : 0x8000;
+        bus->ram[JMP_POINTERS + i * 2] = next & 0xFF;
+        bus->ram[JMP_POINTERS + i * 2 + 1] = next >> 8;
+    }
+    Cpu *cpu = bus->cpu;
+    cpu->pc = start;
+    cpu->cycles = 0;
+    cpu->a = 0x01;
+    cpu->x = INDEX;
+    cpu->y = INDEX;
+    cpu->status = status | U;
+
+    // From the first instruction boundary to the last one counted
+    uint64_t instructions = 0;
+    uint64_t cycles = 0;
+    while (cpu->cycles != 0)
+        cpu_clock();
+    while (instructions < CALIBRATE_INSTRUCTIONS) {
+        do {
+            cpu_clock();
+            cycles++;
+        } while (cpu->cycles != 0);
+        instructions++;
+    }
+    const double cycles_per_instruction = (double)cycles / instructions;
+
+    const double begin = now();
+    for (uint64_t i = 0; i < cycles_per_case; i++)
+        cpu_clock();
+    const double seconds = now() - begin;
+
+    const double ns = seconds * 1e9 / (cycles_per_case / cycles_per_instruction);
+    printf("%-24s %11.2f %10.2f %12.1f\n", name, cycles_per_instruction, ns, cycles_per_case / seconds / 1e6);
+    fflush(stdout);
+    case_count++;
+    bus_free();
+    cartridge_free(cart);
+}
+
+const char *mode_name(const Instruction *inst, const bool accumulator) {
+    if (inst->mode == &IMP)
+        return accumulator ? "A" : "";
+    if (inst->mode == &IMM)
+        return "#";
+    if (inst->mode == &ZP0)
+        return "zp";
+    if (inst->mode == &ZPX)
+        return "zp,X";
+    if (inst->mode == &ZPY)
+        return "zp,Y";
+    if (inst->mode == &ABS)
+        return "abs";
+    if (inst->mode == &ABX)
+        return "abs,X";
+    if (inst->mode == &ABY)
+        return "abs,Y";
+    if (inst->mode == &IZX)
+        return "(zp,X)";
+    if (inst->mode == &IZY)
+        return "(zp),Y";
+    return "?";
+}
+
+// Every instruction that runs straight on to the next, in each of its modes
+void bench_opcodes(void) {
+    static const char *control[] = {"JMP", "JSR", "RTS", "RTI", "BRK"};
+    for (int opcode = 0; opcode < 256; opcode++) {
+        const Instruction *inst = &lut[opcode];
+        if (strcmp(inst->name, "???") == 0 || inst->mode == &REL)
+            continue;
+        bool flow = false;
+        for (size_t i = 0; i < sizeof(control) / sizeof(control[0]); i++)
+            flow |= strcmp(inst->name, control[i]) == 0;
+        if (flow)
+            continue;
+
+        const bool shift = strcmp(inst->name, "ASL") == 0 || strcmp(inst->name, "LSR") == 0 ||
+                           strcmp(inst->name, "ROL") == 0 || strcmp(inst->name, "ROR") == 0;
+        const bool indexed = inst->mode == &ABX || inst->mode == &ABY || inst->mode == &IZY;
+        for (int page = 0; page <= indexed; page++) {
+            uint8_t bytes[3] = {opcode, 0x00, 0x00};
+            uint8_t length = 2;
+            if (inst->mode == &IMP) {
+                length = 1;
+            } else if (inst->mode == &IMM) {
+                bytes[1] = 0x01;
+            } else if (inst->mode == &ZP0 || inst->mode == &ZPX || inst->mode == &ZPY) {
+                bytes[1] = ZP_DATA;
+            } else if (inst->mode == &IZX) {
+                bytes[1] = ZP_POINTER - INDEX;
+            } else if (inst->mode == &IZY) {
+                bytes[1] = page ? ZP_POINTER_PAGE : ZP_POINTER;
+            } else {
+                const uint16_t data = page ? ABS_DATA_PAGE : ABS_DATA;
+                bytes[1] = data & 0xFF;
+                bytes[2] = data >> 8;
+                length = 3;
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "%s%s %s%s", inst->unofficial ? "*" : "", inst->name,
+                     mode_name(inst, shift), page ? " +page" : "");
+            clear_prg();
+            repeat(bytes, length);
+            run_case(name, 0x8000, 0x00);
+        }
+    }
+}
+
+// Each branch taken to the next instruction, not taken, and taken across a page: $8082 and $8100 branch to each
+// other, both landing on the other page
+void bench_branches(void) {
+    static const struct {
+        uint8_t opcode;
+        uint8_t taken; // Status the branch is taken with, it isn't with the flag flipped
+        uint8_t flag;
+    } branches[] = {
+        {0x10, 0, N}, {0x30, N, N}, {0x50, 0, V}, {0x70, V, V}, {0x90, 0, C}, {0xB0, C, C}, {0xD0, 0, Z}, {0xF0, Z, Z},
+    };
+    for (size_t i = 0; i < sizeof(branches) / sizeof(branches[0]); i++) {
+        const uint8_t opcode = branches[i].opcode;
+        const uint8_t bytes[2] = {opcode, 0x00};
+        char name[32];
+
+        snprintf(name, sizeof(name), "%s taken", lut[opcode].name);
+        clear_prg();
+        repeat(bytes, sizeof(bytes));
+        run_case(name, 0x8000, branches[i].taken);
+
+        snprintf(name, sizeof(name), "%s not taken", lut[opcode].name);
+        run_case(name, 0x8000, branches[i].taken ^ branches[i].flag);
+
+        snprintf(name, sizeof(name), "%s taken +page", lut[opcode].name);
+        clear_prg();
+        prg[0x0082] = opcode;
+        prg[0x0083] = 0x7C; // $8084 + $7C = $8100
+        prg[0x0100] = opcode;
+        prg[0x0101] = 0x80; // $8102 - $80 = $8082
+        run_case(name, 0x8082, branches[i].taken);
+    }
+}
+
+void bench_jumps(void) {
+    clear_prg();
+    for (uint16_t i = 0; i < JMP_COUNT; i++) {
+        prg[i * 3] = 0x4C;
+        put_word(0x8000 + i * 3 + 1, i + 1 < JMP_COUNT ? 0x8000 + (i + 1) * 3 : 0x8000);
+    }
+    run_case("JMP abs", 0x8000, 0x00);
+
+    // Pointer i at JMP_POINTERS + 2i holds the address of jump i + 1
+    clear_prg();
+    for (uint16_t i = 0; i < JMP_COUNT; i++) {
+        prg[i * 3] = 0x6C;
+        prg[i * 3 + 1] = (JMP_POINTERS + i * 2) & 0xFF;
+        prg[i * 3 + 2] = (JMP_POINTERS + i * 2) >> 8;
+    }
+    run_case("JMP (ind)", 0x8000, 0x00);
+
+    const uint8_t call[3] = {0x20, SUBROUTINE & 0xFF, SUBROUTINE >> 8};
+    clear_prg();
+    repeat(call, sizeof(call));
+    run_case("JSR abs / RTS", 0x8000, 0x00);
+
+    const uint8_t brk[2] = {0x00, 0xEA}; // BRK skips its padding byte
+    clear_prg();
+    repeat(brk, sizeof(brk));
+    run_case("BRK / RTI", 0x8000, 0x00);
+}
+
+int main(const int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) {
+            cycles_per_case = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: znes-cpu-bench [--cycles N] [--filter TEXT]\n");
+            return 1;
+        }
+    }
+    if (cycles_per_case == 0) {
+        fprintf(stderr, "--cycles needs a positive count.\n");
+        return 1;
+    }
+
+    printf("%-24s %11s %10s %12s\n", "case", "cycles/inst", "ns/inst", "Mcycles/s");
+    const double begin = now();
+    bench_opcodes();
+    bench_branches();
+    bench_jumps();
+    fprintf(stderr, "%u cases in %.1f s\n", case_count, now() - begin);
+    return 0;
+}
@@ -0,0 +1,189 @@
+// znes-ppu-bench: times ppu_clock() alone on canned rendering scenarios.
+//
+// usage: znes-ppu-bench [--frames N] [--filter TEXT]
+//
+// A mapper 000 cartridge with noise in CHR-ROM backs a PPU set up directly: nametables, attributes, palette, OAM and
+// registers are written before each scenario, no CPU runs. Register writes a scenario makes mid-frame go through
+// ppu->write like the bus's would. Each scenario prints ns per dot and frames per second, so a change to the PPU can
+// be measured without the CPU and APU in the way.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cartridge.h"
+#include "ppu.h"
+
+#define PRG_SIZE (16 * 1024)
+#define CHR_SIZE (8 * 1024)
+
+#define DEFAULT_FRAMES 600
+#define FRAME_DOTS (262 * 341 - 1) // Dot 0 of line 0 is always skipped
+
+// $2000 and $2001 bits the scenarios set
+#define CONTROL_PATTERN_SPRITE 0x08
+#define CONTROL_PATTERN_BACKGROUND 0x10
+#define CONTROL_SPRITE_SIZE 0x20
+#define MASK_BACKGROUND 0x0A // Enabled, left column too
+#define MASK_SPRITES 0x14
+
+typedef struct Scenario {
+    const char *name;
+    uint8_t control;
+    uint8_t mask;
+    bool sprites;    // 64 sprites, 8 on each of their lines
+    bool splits;     // Horizontal scroll rewritten on every line
+    bool skip_render;
+} Scenario;
+
+const Scenario scenarios[] = {
+    {"background", CONTROL_PATTERN_BACKGROUND, MASK_BACKGROUND, false, false, false},
+    {"background, skip_render", CONTROL_PATTERN_BACKGROUND, MASK_BACKGROUND, false, false, true},
+    {"64 sprites 8x8", CONTROL_PATTERN_BACKGROUND, MASK_BACKGROUND | MASK_SPRITES, true, false, false},
+    {"64 sprites 8x16", CONTROL_PATTERN_BACKGROUND | CONTROL_SPRITE_SIZE, MASK_BACKGROUND | MASK_SPRITES, true, false,
+     false},
+    {"scroll split every line", CONTROL_PATTERN_BACKGROUND, MASK_BACKGROUND, false, true, false},
+    {"scroll splits, sprites", CONTROL_PATTERN_BACKGROUND | CONTROL_PATTERN_SPRITE, MASK_BACKGROUND | MASK_SPRITES,
+     true, true, false},
+    {"rendering disabled", CONTROL_PATTERN_BACKGROUND, 0x00, false, false, false},
+};
+
+uint32_t frames_per_scenario = DEFAULT_FRAMES;
+const char *filter;
+
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Same pseudo-random bytes on every run
+uint32_t noise(void) {
+    static uint32_t state = 0x2545F491;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// The cartridge maps roms from files, the image goes through a temporary one
+Cartridge *load_cart(void) {
+    char path[] = "/tmp/znes-ppu-bench-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating a temporary rom.\n");
+        return nullptr;
+    }
+    const INesHeader header = {
+        .magic = {'N', 'E', 'S', 0x1A}, .prg_rom_pages = PRG_SIZE / (16 * 1024), .chr_rom_pages = 1, .mapper1 = 0x01};
+    static uint8_t prg[PRG_SIZE];
+    static uint8_t chr[CHR_SIZE];
+    for (uint32_t i = 0; i < CHR_SIZE; i++)
+        chr[i] = noise();
+    FILE *file = fdopen(fd, "wb");
+    const bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(prg, PRG_SIZE, 1, file) == 1 &&
+                         fwrite(chr, CHR_SIZE, 1, file) == 1;
+    fclose(file);
+    Cartridge *cart = written ? cartridge_new(path) : nullptr;
+    unlink(path);
+    return cart;
+}
+
+// Every tile and palette in use, all colours distinct
+void setup_vram(PPU *ppu) {
+    for (uint16_t i = 0; i < 1024; i++) {
+        ppu->nametable[0][i] = i < 960 ? (uint8_t)i : (uint8_t)noise();
+        ppu->nametable[1][i] = i < 960 ? (uint8_t)(255 - i) : (uint8_t)noise();
+    }
+    for (uint8_t i = 0; i < 32; i++)
+        ppu->palette[i] = (i * 7 + 1) & 0x3F;
+}
+
+// Eight rows of eight sprites, spaced so every line of a row has all eight in range
+void setup_oam(PPU *ppu, const bool sprites) {
+    memset(ppu->OAM, 0xFF, sizeof(ppu->OAM));
+    if (!sprites)
+        return;
+    for (uint8_t i = 0; i < 64; i++) {
+        ppu->OAM[i].y = (i / 8) * 28 + 8;
+        ppu->OAM[i].id = i * 2;
+        ppu->OAM[i].attribute = i & 0xC3; // Flips and palette
+        ppu->OAM[i].x = (i % 8) * 30 + 8;
+    }
+}
+
+void run_scenario(PPU *ppu, const Scenario *scenario) {
+    if (filter != nullptr && strstr(scenario->name, filter) == nullptr)
+        return;
+    ppu_reset();
+    setup_vram(ppu);
+    setup_oam(ppu, scenario->sprites);
+    ppu->skip_render = scenario->skip_render;
+    ppu->write(0x0000, scenario->control);
+    ppu->write(0x0001, scenario->mask);
+    ppu->write(0x0005, 0x00);
+    ppu->write(0x0005, 0x00);
+
+    // One frame to settle, timing starts on the pre-render line
+    ppu->frame_complete = false;
+    while (!ppu->frame_complete)
+        ppu_clock();
+
+    uint8_t scroll = 0;
+    const double begin = now();
+    for (uint32_t frame = 0; frame < frames_per_scenario; frame++) {
+        ppu->frame_complete = false;
+        if (!scenario->splits) {
+            while (!ppu->frame_complete)
+                ppu_clock();
+            continue;
+        }
+        // A raster effect's writes after each visible line, picked up at dot 257 of the next
+        while (!ppu->frame_complete) {
+            ppu_clock();
+            if (ppu->cycle == 260 && ppu->scanline >= 0 && ppu->scanline < 240) {
+                ppu->read(0x0002);
+                ppu->write(0x0005, scroll += 3);
+                ppu->write(0x0005, 0x00);
+            }
+        }
+    }
+    const double seconds = now() - begin;
+
+    const double ns = seconds * 1e9 / ((double)frames_per_scenario * FRAME_DOTS);
+    printf("%-26s %8.2f %10.1f\n", scenario->name, ns, frames_per_scenario / seconds);
+    fflush(stdout);
+}
+
+int main(const int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames_per_scenario = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            fprintf(stderr, "usage: znes-ppu-bench [--frames N] [--filter TEXT]\n");
+            return 1;
+        }
+    }
+    if (frames_per_scenario == 0) {
+        fprintf(stderr, "--frames needs a positive count.\n");
+        return 1;
+    }
+
+    Cartridge *cart = load_cart();
+    if (cart == nullptr)
+        return 1;
+    PPU *ppu = ppu_new();
+    ppu->cart = cart;
+
+    printf("%-26s %8s %10s\n", "scenario", "ns/dot", "frames/s");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        run_scenario(ppu, &scenarios[i]);
+
+    ppu_free();
+    cartridge_free(cart);
+    return 0;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Generates src/romdb_data.inc from NES 2.0 XML databases (the nes20db.xml format).
+
+usage: romdb_gen.py OUTPUT DB.xml [DB.xml...]
+
+Each <game> needs a <rom> element with the size, crc32 and sha1 of PRG + CHR-ROM, and a <pcb> element with the mapper.
+Entries are grouped into 2^n buckets by the low bits of their CRC so the emulator finds a dump by looking at a single
+bucket.
+"""
+import sys
+import xml.etree.ElementTree as ET
+
+MIRROR = {'H': 0, 'V': 1, '4': 1, '1': 2}  # Four-screen isn't emulated, it gets vertical
+
+
+def ram_shift(size):
+    if size == 0:
+        return 0
+    shift = 0
+    while (64 << shift) < size:
+        shift += 1
+    return shift
+
+
+def size_of(game, tag):
+    el = game.find(tag)
+    return int(el.get('size', '0')) if el is not None else 0
+
+
+def parse(path):
+    entries = []
+    for game in ET.parse(path).getroot().iter('game'):
+        rom, pcb = game.find('rom'), game.find('pcb')
+        if rom is None or pcb is None:
+            continue
+        console = game.find('console')
+        entries.append({
+            'crc32': int(rom.get('crc32'), 16),
+            'sha1': bytes.fromhex(rom.get('sha1')),
+            'prg': size_of(game, 'prgrom'),
+            'chr': size_of(game, 'chrrom'),
+            'mapper': int(pcb.get('mapper')),
+            'submapper': int(pcb.get('submapper', '0')),
+            'mirror': MIRROR.get(pcb.get('mirroring', 'V'), 1),
+            'timing': int(console.get('region', '0')) if console is not None else 0,
+            'prg_ram': ram_shift(size_of(game, 'prgram')),
+            'prg_nvram': ram_shift(size_of(game, 'prgnvram')),
+            'chr_ram': ram_shift(size_of(game, 'chrram') + size_of(game, 'chrnvram')),
+        })
+    return entries
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    entries = [e for path in sys.argv[2:] for e in parse(path)]
+    # Same dump listed twice (e.g. in two databases): the first one wins
+    seen, unique = set(), []
+    for e in entries:
+        if e['sha1'] not in seen:
+            seen.add(e['sha1'])
+            unique.append(e)
+
+    bits = 0
+    while (1 << bits) < len(unique):
+        bits += 1
+    mask = (1 << bits) - 1
+    unique.sort(key=lambda e: (e['crc32'] & mask, e['crc32']))
+    buckets = [0] * ((1 << bits) + 1)
+    for e in unique:
+        buckets[(e['crc32'] & mask) + 1] += 1
+    for i in range(1, len(buckets)):
+        buckets[i] += buckets[i - 1]
+
+    with open(sys.argv[1], 'w') as out:
+        out.write('// Generated by tools/romdb_gen.py from %s, do not edit\n\n' % ', '.join(sys.argv[2:]))
+        out.write('#define ROMDB_BUCKET_BITS %d\n\n' % bits)
+        out.write('const RomDbEntry romdb_entries[%d] = {\n' % max(len(unique), 1))
+        for e in unique:
+            sha = ', '.join('0x%02X' % b for b in e['sha1'])
+            out.write('    {0x%08X, {%s}, %d, %d, %d, %d, %d, %d, %d, %d, %d},\n' % (
+                e['crc32'], sha, e['prg'], e['chr'], e['mapper'], e['submapper'], e['mirror'], e['timing'],
+                e['prg_ram'], e['prg_nvram'], e['chr_ram']))
+        out.write('};\n\n')
+        out.write('const uint16_t romdb_buckets[%d] = {%s};\n' % (len(buckets), ', '.join(map(str, buckets))))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,79 @@
+// znes-trace-decode: turns an instruction trace dumped by znes --trace into nestest-style text.
+//
+// usage: znes-trace-decode TRACE
+//
+// One line per record, oldest first, with the registers before the instruction ran, where the PPU was and the CPU
+// cycle count since power on:
+//
+//   C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+//
+// Unofficial opcodes get a * in front like in nestest.log. What the dump was written for goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "trace.h"
+
+int main(const int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: znes-trace-decode TRACE\n");
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", argv[1]);
+        return 1;
+    }
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Not an instruction trace.\n");
+        fclose(file);
+        return 1;
+    }
+    if (header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "Trace version %u with %u byte records, this decoder reads version %u with %zu.\n",
+                header.version, header.record_size, TRACE_VERSION, sizeof(TraceRecord));
+        fclose(file);
+        return 1;
+    }
+    header.reason[sizeof(header.reason) - 1] = '\0';
+    fprintf(stderr, "%llu instructions, %llu before them dropped, dumped for: %s\n", (unsigned long long)header.count,
+            (unsigned long long)header.first, header.reason);
+
+    TraceRecord record;
+    uint64_t decoded = 0;
+    while (decoded < header.count && fread(&record, sizeof(record), 1, file) == 1) {
+        const uint8_t bytes[3] = {record.opcode, record.operand[0], record.operand[1]};
+        char text[64];
+        const uint8_t length = disasm_bytes(record.pc, bytes, text, sizeof(text));
+        char *mode = strstr(text, " {");
+        if (mode != nullptr) {
+            // The disassembler leaves the # off immediates, nestest.log has it
+            char *operand = strchr(text, '$');
+            if (strcmp(mode, " {IMM}") == 0 && operand != nullptr) {
+                memmove(operand + 1, operand, (size_t)(mode - operand));
+                *operand = '#';
+                mode++;
+            }
+            *mode = '\0';
+        }
+
+        char hex[9];
+        int used = sprintf(hex, "%02X", bytes[0]);
+        for (uint8_t i = 1; i < length; i++)
+            used += sprintf(hex + used, " %02X", bytes[i]);
+        printf("%04X  %-8s %c%-31s A:%02X X:%02X Y:%02X P:%02X SP:%02X PPU:%3d,%3d CYC:%llu\n", record.pc, hex,
+               lut[record.opcode].unofficial ? '*' : ' ', text, record.a, record.x, record.y, record.status,
+               record.sp, record.scanline, record.dot, (unsigned long long)(record.clock / 3));
+        decoded++;
+    }
+    fclose(file);
+    if (decoded < header.count) {
+        fprintf(stderr, "Trace cut short after %llu records.\n", (unsigned long long)decoded);
+        return 1;
+    }
+    return 0;
+}
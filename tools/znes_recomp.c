@@ -0,0 +1,437 @@
+// znes-recomp: translates the PRG-ROM code of a mapper 000 or 002 rom to C ahead of time.
+//
+// usage: znes-recomp GAME.nes OUTPUT.c [LOG.cdl]
+//
+// Walks the code reachable from the reset, NMI and IRQ vectors, following branches, jumps and calls whose target bank
+// is known, and writes one C function per instruction, grouped by basic block, plus the table that registers them
+// with the core. Build the output into znes with -DZNES_RECOMP_SOURCES=OUTPUT.c; the decode cache then runs those
+// functions in place of the interpreter for that rom. Jumps through pointers, RTS/RTI targets and calls into UxROM's
+// switchable bank from the fixed bank aren't followed, that code stays interpreted. A code/data log written by znes
+// --cdl for the rom fills those in: the walk also starts at every indirect target it saw, then at whatever else it saw
+// run that still isn't reached.
+//
+// The core clocks the PPU between CPU cycles and takes interrupts and DMA between any two instructions, so a block
+// can't run as one call without moving those; every instruction stays its own entry with its exact cycle count. Each
+// function only depends on the bytes at its PRG offset and the offset within the 8KB slot, never on which bank or
+// mirror it runs from, so the walk guessing a bank wrong costs space, not correctness.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cartridge.h"
+#include "cdl.h"
+#include "cpu.h"
+#include "crc32.h"
+
+#define UXROM_BANK_SIZE (16 * 1024)
+
+// Per PRG-ROM byte
+#define CODE_OP 0x01     // An instruction starts here
+#define CODE_LEADER 0x02 // A basic block starts here
+#define CODE_END 0x04    // The instruction here ends its block
+
+const uint8_t *prg;
+uint32_t prg_size;
+uint16_t mapper;
+uint8_t *code;
+uint32_t *queue;
+uint32_t queue_size;
+
+uint8_t op_length(const uint8_t opcode) {
+    const uint8_t bytes[3] = {opcode, 0x00, 0x00};
+    char text[32];
+    return disasm_bytes(0x0000, bytes, text, sizeof(text));
+}
+
+// The CPU address the code at a PRG offset runs from. The 16KB of an NROM-128 are at both $8000 and $C000, the one
+// with the vectors is used.
+uint16_t cpu_address(const uint32_t offset) {
+    if (mapper == 0)
+        return prg_size == UXROM_BANK_SIZE ? 0xC000 | offset : 0x8000 | offset;
+    if (offset >= prg_size - UXROM_BANK_SIZE)
+        return 0xC000 | (offset & (UXROM_BANK_SIZE - 1));
+    return 0x8000 | (offset & (UXROM_BANK_SIZE - 1));
+}
+
+// The PRG offset code at `from` reaches at CPU address `target`, -1 for RAM and for a switchable bank entered from
+// the fixed one. Code in a switchable bank is assumed to stay in it.
+int64_t target_offset(const uint32_t from, const uint16_t target) {
+    if (target < 0x8000)
+        return -1;
+    if (mapper == 0)
+        return (target - 0x8000) & (prg_size - 1);
+    if (target >= 0xC000)
+        return prg_size - UXROM_BANK_SIZE + (target - 0xC000);
+    if (from >= prg_size - UXROM_BANK_SIZE)
+        return -1;
+    return (from & ~(uint32_t)(UXROM_BANK_SIZE - 1)) | (target - 0x8000);
+}
+
+void enqueue(const int64_t offset) {
+    if (offset < 0)
+        return;
+    if (!(code[offset] & (CODE_OP | CODE_LEADER)))
+        queue[queue_size++] = offset;
+    code[offset] |= CODE_LEADER;
+}
+
+// The decode cache only holds instructions that fit in their 8KB slot, and unofficial opcodes stay with the
+// interpreter
+bool translatable(const uint32_t offset) {
+    const Instruction *inst = &lut[prg[offset]];
+    return !inst->unofficial && (offset & (PRG_BANK_SIZE - 1)) + op_length(prg[offset]) <= PRG_BANK_SIZE &&
+           offset + op_length(prg[offset]) <= prg_size;
+}
+
+void walk_block(uint32_t offset) {
+    while (!(code[offset] & CODE_OP)) {
+        if (!translatable(offset))
+            return;
+        code[offset] |= CODE_OP;
+
+        const Instruction *inst = &lut[prg[offset]];
+        const uint16_t pc = cpu_address(offset);
+        const uint16_t next = pc + op_length(prg[offset]);
+        const uint16_t word = (uint16_t)(prg[offset + 2] << 8) | prg[offset + 1];
+        if (inst->mode == &REL) {
+            enqueue(target_offset(offset, next + (int8_t)prg[offset + 1]));
+            enqueue(target_offset(offset, next));
+            code[offset] |= CODE_END;
+            return;
+        }
+        if (strcmp(inst->name, "JMP") == 0) {
+            if (inst->mode == &ABS)
+                enqueue(target_offset(offset, word));
+            code[offset] |= CODE_END;
+            return;
+        }
+        if (strcmp(inst->name, "RTS") == 0 || strcmp(inst->name, "RTI") == 0 || strcmp(inst->name, "BRK") == 0) {
+            code[offset] |= CODE_END;
+            return;
+        }
+        if (strcmp(inst->name, "JSR") == 0) {
+            enqueue(target_offset(offset, word));
+            code[offset] |= CODE_END;
+            enqueue(target_offset(offset, next));
+            return;
+        }
+
+        const int64_t following = target_offset(offset, next);
+        if (following < 0)
+            return;
+        offset = following;
+    }
+    code[offset] |= CODE_LEADER;
+}
+
+void walk(void) {
+    for (uint16_t vector = 0xFFFA; vector != 0x0000; vector += 2) {
+        const uint32_t at = prg_size - 0x10000 + vector;
+        enqueue(target_offset(prg_size - 1, (uint16_t)(prg[at + 1] << 8) | prg[at]));
+    }
+    while (queue_size > 0)
+        walk_block(queue[--queue_size]);
+}
+
+// Walks on from each offset a code/data log has any of `flags` for and the walk hasn't reached yet. One at a time,
+// code logged after a start is then reached from it rather than starting a block of its own.
+void walk_logged(const uint8_t *logged, const uint8_t flags) {
+    for (uint32_t i = 0; i < prg_size; i++) {
+        if (!(logged[i] & flags) || (code[i] & CODE_OP))
+            continue;
+        enqueue(i);
+        while (queue_size > 0)
+            walk_block(queue[--queue_size]);
+    }
+}
+
+// Reads that take the extra cycle when the indexed address crosses a page, the opcode handlers returning 1
+bool adds_page_cycle(const char *name) {
+    static const char *names[] = {"ADC", "AND", "CMP", "EOR", "LDA", "LDX", "LDY", "ORA", "SBC"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Computes `addr` for the addressing mode, `crossed` gets the expression telling if it crossed a page
+void emit_address(FILE *out, const Instruction *inst, const uint8_t lo, const uint16_t word, char *crossed,
+                  const size_t size) {
+    snprintf(crossed, size, "0");
+    if (inst->mode == &ZP0) {
+        fprintf(out, "    const uint16_t addr = 0x%04X;\n", lo);
+    } else if (inst->mode == &ZPX || inst->mode == &ZPY) {
+        fprintf(out, "    const uint16_t addr = (0x%02X + cpu->%c) & 0x00FF;\n", lo, inst->mode == &ZPX ? 'x' : 'y');
+    } else if (inst->mode == &ABS) {
+        fprintf(out, "    const uint16_t addr = 0x%04X;\n", word);
+    } else if (inst->mode == &ABX || inst->mode == &ABY) {
+        fprintf(out, "    const uint16_t addr = 0x%04X + cpu->%c;\n", word, inst->mode == &ABX ? 'x' : 'y');
+        snprintf(crossed, size, "(addr & 0xFF00) != 0x%04X", word & 0xFF00);
+    } else if (inst->mode == &IZX) {
+        fprintf(out, "    const uint16_t lo = cpu_read((0x%02X + cpu->x) & 0x00FF);\n", lo);
+        fprintf(out, "    const uint16_t hi = cpu_read((0x%02X + cpu->x + 1) & 0x00FF);\n", lo);
+        fprintf(out, "    const uint16_t addr = hi << 8 | lo;\n");
+    } else if (inst->mode == &IZY) {
+        fprintf(out, "    const uint16_t lo = cpu_read(0x%04X);\n", lo);
+        fprintf(out, "    const uint16_t hi = cpu_read(0x%04X);\n", (lo + 1) & 0x00FF);
+        fprintf(out, "    const uint16_t addr = (hi << 8 | lo) + cpu->y;\n");
+        snprintf(crossed, size, "(addr & 0xFF00) != hi << 8");
+    } else if (inst->mode == &IND) {
+        const uint16_t hi_ptr = (word & 0x00FF) == 0x00FF ? word & 0xFF00 : word + 1;
+        fprintf(out, "    const uint16_t addr = cpu_read(0x%04X) << 8 | cpu_read(0x%04X);\n", hi_ptr, word);
+    }
+}
+
+// Body of a read-modify-write: `m` is the old value, the new one goes to A or back to memory
+void emit_modify(FILE *out, const Instruction *inst) {
+    const bool acc = inst->mode == &IMP;
+    fprintf(out, "    const uint8_t m = %s;\n", acc ? "cpu->a" : "cpu_read(addr)");
+    if (strcmp(inst->name, "ASL") == 0) {
+        fprintf(out, "    const uint8_t r = m << 1;\n    recomp_carry(m & 0x80);\n");
+    } else if (strcmp(inst->name, "ROL") == 0) {
+        fprintf(out, "    const uint8_t r = m << 1 | (cpu->status & C);\n    recomp_carry(m & 0x80);\n");
+    } else if (strcmp(inst->name, "LSR") == 0) {
+        fprintf(out, "    const uint8_t r = m >> 1;\n    recomp_carry(m & 0x01);\n");
+    } else if (strcmp(inst->name, "ROR") == 0) {
+        fprintf(out, "    const uint8_t r = (cpu->status & C) << 7 | m >> 1;\n    recomp_carry(m & 0x01);\n");
+    } else if (strcmp(inst->name, "INC") == 0) {
+        fprintf(out, "    const uint8_t r = m + 1;\n");
+    } else {
+        fprintf(out, "    const uint8_t r = m - 1;\n");
+    }
+    fprintf(out, "    recomp_nz(r);\n");
+    fprintf(out, acc ? "    cpu->a = r;\n" : "    cpu_write(addr, r);\n");
+}
+
+// The C for one instruction, what its addressing mode and opcode handler do in the interpreter
+void emit_op(FILE *out, const uint32_t offset) {
+    const uint8_t opcode = prg[offset];
+    const Instruction *inst = &lut[opcode];
+    const char *name = inst->name;
+    const uint8_t lo = prg[offset + 1];
+    const uint16_t word = (uint16_t)(prg[offset + 2] << 8) | lo;
+    const uint16_t pc = cpu_address(offset);
+
+    char text[64];
+    disasm_bytes(pc, &prg[offset], text, sizeof(text));
+    fprintf(out, "// $%04X: %s\n", pc, text);
+    fprintf(out, "static uint8_t op_%06X(void) {\n", offset);
+
+    char crossed[32];
+    emit_address(out, inst, lo, word, crossed, sizeof(crossed));
+    char operand[32];
+    if (inst->mode == &IMM)
+        snprintf(operand, sizeof(operand), "0x%02X", lo);
+    else
+        snprintf(operand, sizeof(operand), "cpu_read(addr)");
+
+    const char *reg = name[2] == 'A' ? "a" : name[2] == 'X' ? "x" : "y";
+    if (inst->mode == &REL) {
+        static const char *conditions[] = {
+            "BPL", "!(cpu->status & N)", "BMI", "cpu->status & N", "BVC", "!(cpu->status & V)",
+            "BVS", "cpu->status & V",    "BCC", "!(cpu->status & C)", "BCS", "cpu->status & C",
+            "BNE", "!(cpu->status & Z)", "BEQ", "cpu->status & Z",
+        };
+        const char *condition = "";
+        for (size_t i = 0; i < sizeof(conditions) / sizeof(conditions[0]); i += 2) {
+            if (strcmp(name, conditions[i]) == 0)
+                condition = conditions[i + 1];
+        }
+        // The page of the next instruction's address only depends on the offset in the slot
+        const uint16_t next = (offset & 0x00FF) + 2;
+        const bool crosses = ((next + (int8_t)lo) & 0xFF00) != (next & 0xFF00);
+        fprintf(out, "    if (%s) {\n", condition);
+        fprintf(out, "        cpu->cycles += %d;\n", crosses ? 2 : 1);
+        fprintf(out, "        cpu->pc += %d;\n", (int8_t)lo);
+        fprintf(out, "    }\n");
+    } else if (strcmp(name, "LDA") == 0 || strcmp(name, "LDX") == 0 || strcmp(name, "LDY") == 0) {
+        fprintf(out, "    cpu->%s = %s;\n    recomp_nz(cpu->%s);\n", reg, operand, reg);
+    } else if (strcmp(name, "STA") == 0 || strcmp(name, "STX") == 0 || strcmp(name, "STY") == 0) {
+        fprintf(out, "    cpu_write(addr, cpu->%s);\n", reg);
+    } else if (strcmp(name, "AND") == 0 || strcmp(name, "ORA") == 0 || strcmp(name, "EOR") == 0) {
+        const char op = name[0] == 'A' ? '&' : name[0] == 'O' ? '|' : '^';
+        fprintf(out, "    cpu->a %c= %s;\n    recomp_nz(cpu->a);\n", op, operand);
+    } else if (strcmp(name, "ADC") == 0) {
+        fprintf(out, "    const uint8_t m = %s;\n", operand);
+        fprintf(out, "    const uint16_t r = m + cpu->a + (cpu->status & C);\n");
+        fprintf(out, "    recomp_carry(r & 0xFF00);\n");
+        fprintf(out, "    recomp_overflow(~(cpu->a ^ m) & (cpu->a ^ r) & 0x80);\n");
+        fprintf(out, "    cpu->a = r;\n    recomp_nz(cpu->a);\n");
+    } else if (strcmp(name, "SBC") == 0) {
+        fprintf(out, "    const uint8_t m = %s ^ 0xFF;\n", operand);
+        fprintf(out, "    const uint16_t r = m + cpu->a + (cpu->status & C);\n");
+        fprintf(out, "    recomp_carry(r & 0xFF00);\n");
+        fprintf(out, "    recomp_overflow((r ^ cpu->a) & (r ^ m) & 0x80);\n");
+        fprintf(out, "    cpu->a = r;\n    recomp_nz(cpu->a);\n");
+    } else if (strcmp(name, "CMP") == 0 || strcmp(name, "CPX") == 0 || strcmp(name, "CPY") == 0) {
+        const char *compared = name[1] == 'M' ? "a" : name[2] == 'X' ? "x" : "y";
+        fprintf(out, "    const uint8_t m = %s;\n", operand);
+        fprintf(out, "    recomp_carry(cpu->%s >= m);\n    recomp_nz(cpu->%s - m);\n", compared, compared);
+    } else if (strcmp(name, "BIT") == 0) {
+        fprintf(out, "    const uint8_t m = %s;\n", operand);
+        fprintf(out, "    cpu->status = (cpu->status & ~(Z | N | V)) | ((m & cpu->a) == 0 ? Z : 0) | (m & (N | V));\n");
+    } else if (strcmp(name, "ASL") == 0 || strcmp(name, "LSR") == 0 || strcmp(name, "ROL") == 0 ||
+               strcmp(name, "ROR") == 0 || strcmp(name, "INC") == 0 || strcmp(name, "DEC") == 0) {
+        emit_modify(out, inst);
+    } else if (strcmp(name, "INX") == 0 || strcmp(name, "INY") == 0) {
+        fprintf(out, "    cpu->%s++;\n    recomp_nz(cpu->%s);\n", reg, reg);
+    } else if (strcmp(name, "DEX") == 0 || strcmp(name, "DEY") == 0) {
+        fprintf(out, "    cpu->%s--;\n    recomp_nz(cpu->%s);\n", reg, reg);
+    } else if (name[0] == 'T' && strcmp(name, "TXS") != 0) {
+        const char *from = name[1] == 'A' ? "a" : name[1] == 'X' ? "x" : name[1] == 'Y' ? "y" : "sp";
+        fprintf(out, "    cpu->%s = cpu->%s;\n    recomp_nz(cpu->%s);\n", reg, from, reg);
+    } else if (strcmp(name, "TXS") == 0) {
+        fprintf(out, "    cpu->sp = cpu->x;\n");
+    } else if (name[0] == 'C' && name[1] == 'L') {
+        fprintf(out, "    cpu->status &= ~%c;\n", name[2]);
+    } else if (name[0] == 'S' && name[1] == 'E') {
+        fprintf(out, "    cpu->status |= %c;\n", name[2]);
+    } else if (strcmp(name, "PHA") == 0) {
+        fprintf(out, "    push_byte(cpu->a);\n");
+    } else if (strcmp(name, "PHP") == 0) {
+        fprintf(out, "    push_byte(cpu->status | B | U);\n    cpu->status &= ~(B | U);\n");
+    } else if (strcmp(name, "PLA") == 0) {
+        fprintf(out, "    cpu->a = pop_byte();\n    recomp_nz(cpu->a);\n");
+    } else if (strcmp(name, "PLP") == 0) {
+        fprintf(out, "    cpu->status = pop_byte() | U;\n");
+    } else if (strcmp(name, "JMP") == 0) {
+        fprintf(out, "    cpu->pc = addr;\n");
+    } else if (strcmp(name, "JSR") == 0) {
+        fprintf(out, "    push_word(cpu->pc - 1);\n    cpu->pc = addr;\n");
+    } else if (strcmp(name, "RTS") == 0) {
+        fprintf(out, "    cpu->pc = pop_word() + 1;\n");
+    } else if (strcmp(name, "RTI") == 0) {
+        fprintf(out, "    cpu->status = pop_byte() & ~(B | U);\n    cpu->pc = pop_word();\n");
+    } else if (strcmp(name, "BRK") == 0) {
+        // As BRK() in cpu.c: IMM already stepped over the padding byte, and P is pushed before I is set
+        fprintf(out, "    push_word(cpu->pc);\n    push_byte(cpu->status | B);\n    cpu->status |= I;\n");
+        fprintf(out, "    cpu->pc = cpu_read(0xFFFE) | cpu_read(0xFFFF) << 8;\n");
+    }
+    fprintf(out, "    return %s;\n}\n\n", adds_page_cycle(name) ? crossed : "0");
+}
+
+void emit(FILE *out, const char *rom_path, const char *name, const uint32_t crc) {
+    fprintf(out, "// Generated by znes-recomp from %s, don't edit\n\n#include \"recomp.h\"\n\n", rom_path);
+
+    uint32_t count = 0;
+    for (uint32_t offset = 0; offset < prg_size; offset++) {
+        if (!(code[offset] & CODE_OP))
+            continue;
+        if (code[offset] & CODE_LEADER) {
+            uint32_t instructions = 0;
+            uint32_t cycles = 0;
+            for (uint32_t at = offset; at < prg_size && code[at] & CODE_OP; at += op_length(prg[at])) {
+                instructions++;
+                cycles += lut[prg[at]].cycles;
+                if (code[at] & CODE_END || (at != offset && code[at] & CODE_LEADER))
+                    break;
+            }
+            fprintf(out, "// Block at PRG $%06X: %u instructions, %u base cycles\n\n", offset, instructions, cycles);
+        }
+        emit_op(out, offset);
+        count++;
+    }
+
+    fprintf(out, "static const RecompiledOp ops[] = {\n");
+    for (uint32_t offset = 0; offset < prg_size; offset++) {
+        if (code[offset] & CODE_OP)
+            fprintf(out, "    {0x%06X, &op_%06X},\n", offset, offset);
+    }
+    fprintf(out, "};\n\n");
+    fprintf(out, "static const RecompiledRom rom = {\"%s\", 0x%08X, 0x%06X, %u, ops};\n\n", name, crc, prg_size, count);
+    fprintf(out, "[[gnu::constructor]] static void register_rom(void) { recomp_register(&rom); }\n");
+}
+
+uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", path);
+        return nullptr;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*size);
+    if (fread(data, 1, *size, f) != *size) {
+        fprintf(stderr, "Failed to read %s.\n", path);
+        free(data);
+        data = nullptr;
+    }
+    fclose(f);
+    return data;
+}
+
+int main(const int argc, char **argv) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: znes-recomp GAME.nes OUTPUT.c [LOG.cdl]\n");
+        return 1;
+    }
+
+    size_t rom_size;
+    uint8_t *rom = read_file(argv[1], &rom_size);
+    if (rom == nullptr)
+        return 1;
+    INesHeader header;
+    if (rom_size < sizeof(INesHeader) || memcmp(rom, "NES\x1A", 4) != 0) {
+        fprintf(stderr, "Not a NES rom.\n");
+        return 1;
+    }
+    memcpy(&header, rom, sizeof(INesHeader));
+
+    uint32_t chr_size = header.chr_rom_pages * 8 * 1024;
+    prg_size = header.prg_rom_pages * 16 * 1024;
+    mapper = (header.mapper2 & 0xF0) | header.mapper1 >> 4;
+    if ((header.mapper2 & 0x0C) == 0x08) {
+        mapper |= (uint16_t)(header.prg_ram_pages & 0x0F) << 8;
+        prg_size += (uint32_t)(header.tv_system1 & 0x0F) << 8 << 14;
+        chr_size += (uint32_t)(header.tv_system1 >> 4) << 8 << 13;
+    }
+    const size_t offset = sizeof(INesHeader) + (header.mapper1 & 0x04 ? 512 : 0);
+    if (mapper != 0 && mapper != 2) {
+        fprintf(stderr, "Only mapper 000 and 002 roms can be translated, this one is %03d.\n", mapper);
+        return 1;
+    }
+    if (prg_size < UXROM_BANK_SIZE || (prg_size & (prg_size - 1)) != 0 || rom_size < offset + prg_size) {
+        fprintf(stderr, "Unexpected PRG-ROM size %u.\n", prg_size);
+        return 1;
+    }
+    prg = rom + offset;
+
+    // The same hash the cartridge gets when it's loaded
+    const size_t data_size = rom_size - offset;
+    const size_t hashed = prg_size + (size_t)chr_size;
+    const uint32_t crc = crc32(0, prg, hashed <= data_size ? hashed : data_size);
+
+    code = calloc(prg_size, 1);
+    queue = calloc(prg_size, sizeof(uint32_t));
+    walk();
+    if (argc == 4) {
+        uint32_t logged_chr;
+        uint8_t *logged = cdl_load(argv[3], crc, prg_size, &logged_chr);
+        if (logged == nullptr)
+            return 1;
+        walk_logged(logged, CDL_INDIRECT);
+        walk_logged(logged, CDL_CODE);
+        free(logged);
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (out == nullptr) {
+        fprintf(stderr, "Error opening %s.\n", argv[2]);
+        return 1;
+    }
+    const char *name = strrchr(argv[1], '/') != nullptr ? strrchr(argv[1], '/') + 1 : argv[1];
+    emit(out, argv[1], name, crc);
+    fclose(out);
+
+    uint32_t ops = 0;
+    for (uint32_t i = 0; i < prg_size; i++)
+        ops += code[i] & CODE_OP;
+    fprintf(stderr, "%s: %u instructions translated\n", name, ops);
+    free(queue);
+    free(code);
+    free(rom);
+    return 0;
+}